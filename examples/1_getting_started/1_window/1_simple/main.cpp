@@ -1,12 +1,15 @@
 #include <cuiui/cuiui.hpp>
 #include <cuiui/platform/defaults.hpp>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 
 namespace cuiui_default = cuiui::platform::defaults;
 
 int main() {
     cuiui_default::Context ui;
     ui.window({.id = "w", .size = {400, 400}});
+    FrameStats frame_stats("window_simple");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
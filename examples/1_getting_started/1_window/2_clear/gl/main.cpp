@@ -2,6 +2,7 @@
 #include <cuiui/platform/defaults.hpp>
 #include <coel/opengl/core.hpp>
 #include <glad/glad.h>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 namespace cuiui_default = cuiui::platform::defaults;
 int main() {
     cuiui_default::Context ui;
@@ -12,7 +13,9 @@ int main() {
         gl_ctx.make_current();
         gladLoadGL();
     }
+    FrameStats frame_stats("clear_gl");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
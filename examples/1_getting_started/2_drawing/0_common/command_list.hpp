@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+// 64-bit draw sort keys, compared as plain integers. Opaque draws sort by
+//
+//   pass (4) | shader (12) | material (16) | depth (32)
+//
+// so each pass switches programs as rarely as possible, then textures, and
+// within a material goes front to back for early depth rejection. Blended
+// draws must be drawn back to front regardless of state, so their depth
+// (inverted) moves up above shader and material.
+//
+// Shader and material are small ids chosen by the caller (GL object names
+// work while they stay below 4096 and 65536); higher bits are dropped.
+// Depth is view-space distance, >= 0.
+struct SortKey {
+    static constexpr u32 PASS_BITS = 4;
+    static constexpr u32 SHADER_BITS = 12;
+    static constexpr u32 MATERIAL_BITS = 16;
+    static constexpr u32 DEPTH_BITS = 32;
+
+    // Non-negative floats order the same as their bit patterns.
+    static u32 depth_bits(f32 depth) {
+        return std::bit_cast<u32>(depth > 0.0f ? depth : 0.0f);
+    }
+
+    static u64 front_to_back(u32 pass, u32 shader, u32 material, f32 depth) {
+        return (u64{pass & mask(PASS_BITS)} << 60) |
+               (u64{shader & mask(SHADER_BITS)} << 48) |
+               (u64{material & mask(MATERIAL_BITS)} << 32) |
+               u64{depth_bits(depth)};
+    }
+
+    static u64 back_to_front(u32 pass, f32 depth, u32 shader, u32 material) {
+        return (u64{pass & mask(PASS_BITS)} << 60) |
+               (u64{~depth_bits(depth)} << 28) |
+               (u64{shader & mask(SHADER_BITS)} << 16) |
+               u64{material & mask(MATERIAL_BITS)};
+    }
+
+    static u32 pass(u64 key) {
+        return static_cast<u32>(key >> 60);
+    }
+
+  private:
+    static constexpr u32 mask(u32 bits) {
+        return (1u << bits) - 1;
+    }
+};
+
+// Everything needed to replay one draw, with GL object names instead of
+// the owning objects so packets can be recorded on any thread.
+struct DrawPacket {
+    u64 key = 0;
+    u32 program_id = 0;
+    u32 vertex_array_id = 0;
+    // texture_id 0 leaves the slot alone
+    u32 texture_id = 0;
+    u32 texture_slot = 0;
+    // Per-draw uniforms, bound as a GL_UNIFORM_BUFFER range; buffer 0 binds
+    // nothing. Record-time allocation must not race, so parallel recorders
+    // carve these out of one UniformRing allocation made beforehand.
+    u32 uniform_buffer_id = 0;
+    u32 uniform_binding = 0;
+    u32 uniform_offset = 0;
+    u32 uniform_size = 0;
+    GLenum mode = GL_TRIANGLES;
+    u32 count = 0;
+    // first index (indexed) or first vertex
+    u32 first = 0;
+    i32 base_vertex = 0;
+    u32 instance_n = 1;
+    bool indexed = false;
+};
+
+struct CommandList {
+    std::vector<DrawPacket> packets;
+
+    void clear() {
+        packets.clear();
+    }
+    void push(const DrawPacket &packet) {
+        packets.push_back(packet);
+    }
+};
+
+// Replays packets to the GL context through the state cache.
+struct GlCommandBackend {
+    GlStateCache &state() {
+        return gl_state();
+    }
+    void draw(const DrawPacket &packet) {
+        auto mode = packet.mode;
+        auto count = static_cast<GLsizei>(packet.count);
+        auto instance_n = static_cast<GLsizei>(packet.instance_n);
+        if (packet.indexed) {
+            const auto *offset = reinterpret_cast<const void *>(size_t{packet.first} * sizeof(u32));
+            glDrawElementsInstancedBaseVertex(mode, count, GL_UNSIGNED_INT, offset, instance_n, packet.base_vertex);
+        } else {
+            glDrawArraysInstanced(mode, static_cast<GLint>(packet.first), count, instance_n);
+        }
+    }
+};
+
+// A GlApi that does nothing, so the state cache still counts what would
+// have been issued.
+struct NullGlApi {
+    void enable(GLenum, bool) {}
+    void depth_func(GLenum) {}
+    void blend_func(GLenum, GLenum) {}
+    void viewport(i32, i32, i32, i32) {}
+    void clear_color(f32, f32, f32, f32) {}
+    void clear_depth(f64) {}
+    void use_program(u32) {}
+    void bind_vertex_array(u32) {}
+    void bind_buffer(GLenum, u32) {}
+    void bind_buffer_range(GLenum, u32, u32, size_t, size_t) {}
+    void bind_texture_unit(u32, u32) {}
+};
+
+// Swallows everything, for timing record/sort/submit without a context
+// or to see how many state changes an ordering costs.
+struct NullCommandBackend {
+    BasicGlStateCache<NullGlApi> state_cache;
+    u64 draw_n = 0;
+    u64 index_n = 0;
+
+    BasicGlStateCache<NullGlApi> &state() {
+        return state_cache;
+    }
+    void draw(const DrawPacket &packet) {
+        ++draw_n;
+        index_n += u64{packet.count} * packet.instance_n;
+    }
+};
+
+// Deferred draws for one frame. Recording fills independent CommandLists,
+// so scene traversal can run on every core without locks; `sort` merges
+// them by key and `submit` replays the result on the calling thread, which
+// must own the context when the backend is GL.
+//
+//     queue.clear();
+//     queue.record(objects.size(), [&](CommandList &list, size_t i) { list.push(...); });
+//     queue.sort();
+//     queue.submit(backend);
+//
+// Packets with equal keys keep their record order.
+struct CommandQueue {
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 256;
+
+    struct Entry {
+        u64 key;
+        u32 list_i;
+        u32 packet_i;
+    };
+
+    struct Stats {
+        u32 packet_n = 0;
+        u32 list_n = 0;
+        f64 record_ms = 0.0;
+        f64 sort_ms = 0.0;
+        f64 submit_ms = 0.0;
+    };
+
+    std::vector<CommandList> lists;
+    size_t list_n = 0;
+    std::vector<Entry> entries;
+    Stats stats;
+
+    void clear() {
+        for (size_t i = 0; i < list_n; ++i)
+            lists[i].clear();
+        list_n = 0;
+        entries.clear();
+        stats = {};
+    }
+
+    // A list for recording on the calling thread.
+    CommandList &new_list() {
+        if (list_n == lists.size())
+            lists.emplace_back();
+        return lists[list_n++];
+    }
+
+    // Calls fn(list, i) for i in [0, n) across all cores. Each chunk of
+    // items records into its own list, so `fn` only has to be safe to run
+    // concurrently for different items.
+    void record(size_t n, auto &&fn, size_t chunk_size = DEFAULT_CHUNK_SIZE) {
+        PROFILE_SCOPE("command_record");
+        auto start = clock::now();
+        size_t chunk_n = (n + chunk_size - 1) / chunk_size;
+        size_t first_list = list_n;
+        for (size_t c = 0; c < chunk_n; ++c)
+            new_list();
+        parallel_for(chunk_n, [&](size_t c) {
+            auto &list = lists[first_list + c];
+            size_t end = std::min(n, (c + 1) * chunk_size);
+            for (size_t i = c * chunk_size; i < end; ++i)
+                fn(list, i);
+        });
+        stats.record_ms += elapsed_ms(start);
+    }
+
+    void sort() {
+        PROFILE_SCOPE("command_sort");
+        auto start = clock::now();
+        entries.clear();
+        for (size_t l = 0; l < list_n; ++l) {
+            const auto &packets = lists[l].packets;
+            for (size_t p = 0; p < packets.size(); ++p)
+                entries.push_back({packets[p].key, static_cast<u32>(l), static_cast<u32>(p)});
+        }
+        radix_sort(entries, scratch);
+        stats.packet_n = static_cast<u32>(entries.size());
+        stats.list_n = static_cast<u32>(list_n);
+        stats.sort_ms += elapsed_ms(start);
+    }
+
+    void submit(auto &backend) {
+        PROFILE_SCOPE("command_submit");
+        auto start = clock::now();
+        auto &state = backend.state();
+        for (const auto &entry : entries) {
+            const auto &packet = lists[entry.list_i].packets[entry.packet_i];
+            state.use_program(packet.program_id);
+            state.bind_vertex_array(packet.vertex_array_id);
+            if (packet.texture_id)
+                state.bind_texture_unit(packet.texture_slot, packet.texture_id);
+            if (packet.uniform_buffer_id)
+                state.bind_buffer_range(GL_UNIFORM_BUFFER, packet.uniform_binding, packet.uniform_buffer_id, packet.uniform_offset, packet.uniform_size);
+            backend.draw(packet);
+        }
+        stats.submit_ms += elapsed_ms(start);
+    }
+
+    // Stable LSD radix sort on the key, a byte per pass. Histograms for
+    // all eight bytes come from one read, and bytes that are the same in
+    // every key (unused passes, a single shader) are skipped.
+    static void radix_sort(std::vector<Entry> &values, std::vector<Entry> &temp) {
+        constexpr size_t BYTE_N = sizeof(u64);
+        std::array<std::array<u32, 256>, BYTE_N> histograms{};
+        for (const auto &value : values) {
+            for (size_t b = 0; b < BYTE_N; ++b)
+                ++histograms[b][(value.key >> (b * 8)) & 0xff];
+        }
+        temp.resize(values.size());
+        for (size_t b = 0; b < BYTE_N; ++b) {
+            auto &counts = histograms[b];
+            if (values.empty() || counts[(values[0].key >> (b * 8)) & 0xff] == values.size())
+                continue;
+            u32 offset = 0;
+            for (auto &count : counts) {
+                auto n = count;
+                count = offset;
+                offset += n;
+            }
+            for (const auto &value : values)
+                temp[counts[(value.key >> (b * 8)) & 0xff]++] = value;
+            values.swap(temp);
+        }
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    std::vector<Entry> scratch;
+
+    static f64 elapsed_ms(clock::time_point start) {
+        return std::chrono::duration<f64, std::milli>(clock::now() - start).count();
+    }
+};
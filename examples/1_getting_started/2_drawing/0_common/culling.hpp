@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_USE_SSE2 1
+#else
+#define CULLING_USE_SSE2 0
+#endif
+
+struct CullStats {
+    u32 total_n = 0;
+    u32 frustum_culled_n = 0;
+    u32 occlusion_culled_n = 0;
+    u32 visible_n = 0;
+};
+
+// f32mat4 is column-major, matching the layout uploaded to GL.
+inline f32 mat_elem(const f32mat4 &m, size_t row, size_t col) {
+    return reinterpret_cast<const f32 *>(&m)[col * 4 + row];
+}
+
+inline f32vec4 transform_point(const f32mat4 &m, f32vec3 p) {
+    f32vec4 result;
+    for (size_t r = 0; r < 4; ++r)
+        result[r] = mat_elem(m, r, 0) * p[0] + mat_elem(m, r, 1) * p[1] + mat_elem(m, r, 2) * p[2] + mat_elem(m, r, 3);
+    return result;
+}
+
+// Planes as (a, b, c, d) with ax + by + cz + d >= 0 inside, extracted from
+// a view-projection matrix (Gribb & Hartmann).
+struct Frustum {
+    std::array<f32vec4, 6> planes;
+
+    Frustum(const f32mat4 &view_proj) {
+        auto row = [&](size_t r) {
+            return f32vec4{mat_elem(view_proj, r, 0), mat_elem(view_proj, r, 1), mat_elem(view_proj, r, 2), mat_elem(view_proj, r, 3)};
+        };
+        auto r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+        for (size_t k = 0; k < 4; ++k) {
+            planes[0][k] = r3[k] + r0[k];
+            planes[1][k] = r3[k] - r0[k];
+            planes[2][k] = r3[k] + r1[k];
+            planes[3][k] = r3[k] - r1[k];
+            planes[4][k] = r3[k] + r2[k];
+            planes[5][k] = r3[k] - r2[k];
+        }
+    }
+};
+
+// World-space AABBs stored as separate center/extent arrays so the frustum
+// test can run on four boxes per SSE register.
+struct BoundsSoA {
+    std::vector<f32> cx, cy, cz;
+    std::vector<f32> ex, ey, ez;
+
+    size_t size() const {
+        return cx.size();
+    }
+
+    void resize(size_t n) {
+        cx.resize(n), cy.resize(n), cz.resize(n);
+        ex.resize(n), ey.resize(n), ez.resize(n);
+    }
+
+    void push_back(const f32mat4 &m, f32vec3 bounds_min, f32vec3 bounds_max) {
+        resize(size() + 1);
+        set(size() - 1, m, bounds_min, bounds_max);
+    }
+
+    // Transforms a model-space AABB by `m` (Arvo's method) and stores the
+    // resulting world-space AABB in slot `i`.
+    void set(size_t i, const f32mat4 &m, f32vec3 bounds_min, f32vec3 bounds_max) {
+        f32vec3 c, e;
+        for (size_t k = 0; k < 3; ++k) {
+            c[k] = (bounds_min[k] + bounds_max[k]) * 0.5f;
+            e[k] = (bounds_max[k] - bounds_min[k]) * 0.5f;
+        }
+        f32 wc[3], we[3];
+        for (size_t r = 0; r < 3; ++r) {
+            wc[r] = mat_elem(m, r, 3);
+            we[r] = 0.0f;
+            for (size_t k = 0; k < 3; ++k) {
+                wc[r] += mat_elem(m, r, k) * c[k];
+                we[r] += std::abs(mat_elem(m, r, k)) * e[k];
+            }
+        }
+        cx[i] = wc[0], cy[i] = wc[1], cz[i] = wc[2];
+        ex[i] = we[0], ey[i] = we[1], ez[i] = we[2];
+    }
+
+    f32vec3 min_corner(size_t i) const {
+        return {cx[i] - ex[i], cy[i] - ey[i], cz[i] - ez[i]};
+    }
+    f32vec3 max_corner(size_t i) const {
+        return {cx[i] + ex[i], cy[i] + ey[i], cz[i] + ez[i]};
+    }
+};
+
+// Writes 1 to `visible[i]` for boxes intersecting the frustum and 0 for
+// the rest.
+inline void frustum_cull(const Frustum &frustum, const BoundsSoA &bounds, std::span<u8> visible) {
+    size_t n = bounds.size();
+    size_t i = 0;
+#if CULLING_USE_SSE2
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 cx = _mm_loadu_ps(bounds.cx.data() + i), cy = _mm_loadu_ps(bounds.cy.data() + i), cz = _mm_loadu_ps(bounds.cz.data() + i);
+        __m128 ex = _mm_loadu_ps(bounds.ex.data() + i), ey = _mm_loadu_ps(bounds.ey.data() + i), ez = _mm_loadu_ps(bounds.ez.data() + i);
+        __m128 outside = _mm_setzero_ps();
+        for (const auto &p : frustum.planes) {
+            __m128 a = _mm_set1_ps(p[0]), b = _mm_set1_ps(p[1]), c = _mm_set1_ps(p[2]), d = _mm_set1_ps(p[3]);
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_add_ps(_mm_mul_ps(c, cz), d));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, a), ex), _mm_mul_ps(_mm_andnot_ps(sign_mask, b), ey)), _mm_mul_ps(_mm_andnot_ps(sign_mask, c), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (size_t k = 0; k < 4; ++k)
+            visible[i + k] = static_cast<u8>(((mask >> k) & 1) ^ 1);
+    }
+#endif
+    for (; i < n; ++i) {
+        bool outside = false;
+        for (const auto &p : frustum.planes) {
+            f32 dist = p[0] * bounds.cx[i] + p[1] * bounds.cy[i] + p[2] * bounds.cz[i] + p[3];
+            f32 radius = std::abs(p[0]) * bounds.ex[i] + std::abs(p[1]) * bounds.ey[i] + std::abs(p[2]) * bounds.ez[i];
+            outside |= dist + radius < 0.0f;
+        }
+        visible[i] = outside ? 0 : 1;
+    }
+}
+
+// Small software depth buffer for occlusion culling. Occluder triangles
+// are rasterised at low resolution storing the nearest depth; an occludee
+// is hidden if every pixel under its screen rectangle holds something
+// nearer than the nearest point of its bounds.
+//
+// Coverage is sampled at pixel centres, so thin occluders can hide slivers
+// of geometry at the edges; at this resolution that is not noticeable.
+struct DepthRasterizer {
+    static constexpr u32 SIZE_X = 256, SIZE_Y = 128;
+    std::vector<f32> depth = std::vector<f32>(SIZE_X * SIZE_Y, 1.0f);
+
+    void clear() {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+    }
+
+    // NDC -> pixel space, with z remapped to [0, 1]
+    static f32vec3 to_screen(f32vec4 clip) {
+        f32 inv_w = 1.0f / clip[3];
+        return {
+            (clip[0] * inv_w * 0.5f + 0.5f) * static_cast<f32>(SIZE_X),
+            (clip[1] * inv_w * 0.5f + 0.5f) * static_cast<f32>(SIZE_Y),
+            clip[2] * inv_w * 0.5f + 0.5f,
+        };
+    }
+
+    void rasterize_triangle(f32vec4 c0, f32vec4 c1, f32vec4 c2) {
+        // No clipping: triangles that reach behind the near plane are
+        // skipped, which only makes the buffer more conservative.
+        constexpr f32 MIN_W = 1e-5f;
+        if (c0[3] < MIN_W || c1[3] < MIN_W || c2[3] < MIN_W)
+            return;
+        auto p0 = to_screen(c0), p1 = to_screen(c1), p2 = to_screen(c2);
+        f32 area = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p1[1] - p0[1]) * (p2[0] - p0[0]);
+        if (std::abs(area) < 1e-8f)
+            return;
+        f32 inv_area = 1.0f / area;
+        auto x0 = static_cast<i32>(std::max(0.0f, std::floor(std::min({p0[0], p1[0], p2[0]}))));
+        auto y0 = static_cast<i32>(std::max(0.0f, std::floor(std::min({p0[1], p1[1], p2[1]}))));
+        auto x1 = static_cast<i32>(std::min(static_cast<f32>(SIZE_X - 1), std::ceil(std::max({p0[0], p1[0], p2[0]}))));
+        auto y1 = static_cast<i32>(std::min(static_cast<f32>(SIZE_Y - 1), std::ceil(std::max({p0[1], p1[1], p2[1]}))));
+        for (i32 y = y0; y <= y1; ++y) {
+            f32 py = static_cast<f32>(y) + 0.5f;
+            for (i32 x = x0; x <= x1; ++x) {
+                f32 px = static_cast<f32>(x) + 0.5f;
+                // barycentrics; the sign of `area` takes care of winding
+                f32 w0 = ((p1[0] - px) * (p2[1] - py) - (p1[1] - py) * (p2[0] - px)) * inv_area;
+                f32 w1 = ((p2[0] - px) * (p0[1] - py) - (p2[1] - py) * (p0[0] - px)) * inv_area;
+                f32 w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                f32 z = w0 * p0[2] + w1 * p1[2] + w2 * p2[2];
+                auto &d = depth[static_cast<size_t>(y) * SIZE_X + static_cast<size_t>(x)];
+                d = std::min(d, z);
+            }
+        }
+    }
+
+    // Tests a world-space AABB against the buffer.
+    bool is_occluded(const f32mat4 &view_proj, f32vec3 bounds_min, f32vec3 bounds_max) const {
+        f32 sx0 = std::numeric_limits<f32>::max(), sy0 = sx0, sz0 = sx0;
+        f32 sx1 = std::numeric_limits<f32>::lowest(), sy1 = sx1;
+        for (u32 corner = 0; corner < 8; ++corner) {
+            f32vec3 p = {
+                (corner & 1) ? bounds_max[0] : bounds_min[0],
+                (corner & 2) ? bounds_max[1] : bounds_min[1],
+                (corner & 4) ? bounds_max[2] : bounds_min[2],
+            };
+            auto clip = transform_point(view_proj, p);
+            // Straddling the near plane: the projected rect is unbounded.
+            if (clip[3] <= 1e-5f)
+                return false;
+            auto s = to_screen(clip);
+            sx0 = std::min(sx0, s[0]), sx1 = std::max(sx1, s[0]);
+            sy0 = std::min(sy0, s[1]), sy1 = std::max(sy1, s[1]);
+            sz0 = std::min(sz0, s[2]);
+        }
+        auto x0 = static_cast<i32>(std::max(0.0f, std::floor(sx0)));
+        auto y0 = static_cast<i32>(std::max(0.0f, std::floor(sy0)));
+        auto x1 = static_cast<i32>(std::min(static_cast<f32>(SIZE_X - 1), std::ceil(sx1)));
+        auto y1 = static_cast<i32>(std::min(static_cast<f32>(SIZE_Y - 1), std::ceil(sy1)));
+        if (x0 > x1 || y0 > y1)
+            return false;
+        for (i32 y = y0; y <= y1; ++y) {
+            for (i32 x = x0; x <= x1; ++x) {
+                if (depth[static_cast<size_t>(y) * SIZE_X + static_cast<size_t>(x)] >= sz0)
+                    return false;
+            }
+        }
+        return true;
+    }
+};
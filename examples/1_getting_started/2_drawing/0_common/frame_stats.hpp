@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+// Log-linear histogram of durations in microseconds (HDR-style): each
+// power of two is split into SUB_BUCKET_N linear buckets, so any
+// recorded value is known to within 1/SUB_BUCKET_N (~3%) from 1 us to
+// over a minute, in fixed memory. Counts are relaxed atomics, so any
+// thread can record without a lock.
+struct DurationHistogram {
+    static constexpr u32 SUB_BUCKET_BITS = 5;
+    static constexpr u32 SUB_BUCKET_N = 1u << SUB_BUCKET_BITS;
+    static constexpr u32 MAGNITUDE_N = 27;
+    static constexpr u32 BUCKET_N = (MAGNITUDE_N + 1) * SUB_BUCKET_N;
+
+    std::array<std::atomic<u64>, BUCKET_N> counts{};
+    std::atomic<u64> total_n = 0;
+    std::atomic<u64> total_us = 0;
+    std::atomic<u64> max_us = 0;
+
+    // Values below SUB_BUCKET_N get a bucket each; above that, the top
+    // SUB_BUCKET_BITS + 1 bits pick the bucket.
+    static u32 bucket_of(u64 us) {
+        if (us < SUB_BUCKET_N)
+            return static_cast<u32>(us);
+        auto magnitude = static_cast<u32>(std::bit_width(us)) - SUB_BUCKET_BITS;
+        if (magnitude > MAGNITUDE_N)
+            return BUCKET_N - 1;
+        auto sub = static_cast<u32>(us >> (magnitude - 1)) - SUB_BUCKET_N;
+        return magnitude * SUB_BUCKET_N + sub;
+    }
+
+    // Largest value that lands in `bucket`.
+    static u64 upper_bound_of(u32 bucket) {
+        if (bucket < SUB_BUCKET_N)
+            return bucket;
+        auto magnitude = bucket / SUB_BUCKET_N, sub = bucket % SUB_BUCKET_N;
+        return ((u64{SUB_BUCKET_N + sub} + 1) << (magnitude - 1)) - 1;
+    }
+
+    void record(u64 us) {
+        counts[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+        total_n.fetch_add(1, std::memory_order_relaxed);
+        total_us.fetch_add(us, std::memory_order_relaxed);
+        auto prev = max_us.load(std::memory_order_relaxed);
+        while (prev < us && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Upper bound of the bucket holding the `p`th percentile, p in [0, 100].
+    u64 percentile(f64 p) const {
+        auto n = total_n.load(std::memory_order_relaxed);
+        if (n == 0)
+            return 0;
+        auto rank = std::max<u64>(1, static_cast<u64>(p / 100.0 * static_cast<f64>(n) + 0.5));
+        u64 seen = 0;
+        for (u32 i = 0; i < BUCKET_N; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(upper_bound_of(i), max_us.load(std::memory_order_relaxed));
+        }
+        return max_us.load(std::memory_order_relaxed);
+    }
+
+    f64 mean() const {
+        auto n = total_n.load(std::memory_order_relaxed);
+        return n ? static_cast<f64>(total_us.load(std::memory_order_relaxed)) / static_cast<f64>(n) : 0.0;
+    }
+};
+
+// Frame-time statistics for a main loop: call `tick` once per frame.
+// Besides the histogram it flags hitches, frames that take more than
+// HITCH_FACTOR times the recent average, which mean FPS hides. The
+// average is an exponential moving average into which hitches only go
+// clamped to the threshold: a lone spike barely moves it, but a lasting
+// change in load (8 ms -> 20 ms) is followed within a few frames instead
+// of every later frame counting as a hitch. Per-frame times are kept, up
+// to MAX_SAMPLES, for the CSV.
+//
+// On destruction it prints a one-line summary and, if `name` is set,
+// writes <name>_frame_times.csv and <name>_frame_stats.json to the
+// working directory.
+struct FrameStats {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr f64 HITCH_FACTOR = 2.0;
+    static constexpr f64 EMA_WEIGHT = 0.05;
+    // the first frames include startup work and are not counted
+    static constexpr u32 WARMUP_FRAMES = 10;
+    static constexpr size_t MAX_SAMPLES = size_t{1} << 20;
+
+    struct Hitch {
+        u64 frame;
+        f64 ms;
+        f64 average_ms;
+    };
+
+    std::string name;
+    DurationHistogram histogram;
+    std::vector<f32> samples_ms;
+    std::vector<Hitch> hitches;
+    u64 frame_n = 0;
+    f64 average_ms = 0.0;
+    clock::time_point prev_time;
+
+    FrameStats(std::string name_ = {}) : name(std::move(name_)) {
+        prev_time = clock::now();
+    }
+
+    FrameStats(const FrameStats &) = delete;
+    FrameStats &operator=(const FrameStats &) = delete;
+
+    ~FrameStats() {
+        print_summary();
+        if (!name.empty()) {
+            write_csv(name + "_frame_times.csv");
+            write_json(name + "_frame_stats.json");
+        }
+    }
+
+    // Returns the duration of the frame that just ended, in seconds.
+    f64 tick() {
+        auto now = clock::now();
+        auto elapsed = std::chrono::duration<f64>(now - prev_time).count();
+        prev_time = now;
+        if (frame_n++ < WARMUP_FRAMES)
+            return elapsed;
+        auto ms = elapsed * 1000.0;
+        histogram.record(static_cast<u64>(elapsed * 1e6 + 0.5));
+        if (samples_ms.size() < MAX_SAMPLES)
+            samples_ms.push_back(static_cast<f32>(ms));
+        if (average_ms == 0.0) {
+            average_ms = ms;
+            return elapsed;
+        }
+        auto threshold = average_ms * HITCH_FACTOR;
+        if (ms > threshold)
+            hitches.push_back({frame_n - 1, ms, average_ms});
+        average_ms += (std::min(ms, threshold) - average_ms) * EMA_WEIGHT;
+        return elapsed;
+    }
+
+    f64 percentile_ms(f64 p) const {
+        return static_cast<f64>(histogram.percentile(p)) * 1e-3;
+    }
+    f64 max_ms() const {
+        return static_cast<f64>(histogram.max_us.load(std::memory_order_relaxed)) * 1e-3;
+    }
+
+    void print_summary() const {
+        if (histogram.total_n.load(std::memory_order_relaxed) == 0)
+            return;
+        std::cout << (name.empty() ? "frames" : name) << ": " << histogram.total_n.load(std::memory_order_relaxed) << " frames, mean "
+                  << histogram.mean() * 1e-3 << " ms, p50 " << percentile_ms(50.0) << " ms, p95 " << percentile_ms(95.0) << " ms, p99 "
+                  << percentile_ms(99.0) << " ms, max " << max_ms() << " ms, " << hitches.size() << " hitches\n";
+    }
+
+    bool write_csv(const std::filesystem::path &path) const {
+        auto out = std::ofstream(path, std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::FRAME_STATS::could not write " << path.string() << std::endl;
+            return false;
+        }
+        out << "frame,ms,hitch\n";
+        size_t hitch_i = 0;
+        for (size_t i = 0; i < samples_ms.size(); ++i) {
+            auto frame = i + WARMUP_FRAMES;
+            bool hitch = hitch_i < hitches.size() && hitches[hitch_i].frame == frame;
+            if (hitch)
+                ++hitch_i;
+            out << frame << ',' << samples_ms[i] << ',' << (hitch ? 1 : 0) << '\n';
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool write_json(const std::filesystem::path &path) const {
+        auto out = std::ofstream(path, std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::FRAME_STATS::could not write " << path.string() << std::endl;
+            return false;
+        }
+        out << "{\n  \"frames\": " << histogram.total_n.load(std::memory_order_relaxed) << ",\n  \"mean_ms\": " << histogram.mean() * 1e-3
+            << ",\n  \"p50_ms\": " << percentile_ms(50.0) << ",\n  \"p95_ms\": " << percentile_ms(95.0) << ",\n  \"p99_ms\": " << percentile_ms(99.0)
+            << ",\n  \"p999_ms\": " << percentile_ms(99.9) << ",\n  \"max_ms\": " << max_ms() << ",\n  \"hitches\": [";
+        for (size_t i = 0; i < hitches.size(); ++i)
+            out << (i ? ", " : "") << "{\"frame\": " << hitches[i].frame << ", \"ms\": " << hitches[i].ms << ", \"average_ms\": " << hitches[i].average_ms << "}";
+        out << "],\n  \"histogram\": [";
+        bool first = true;
+        for (u32 i = 0; i < DurationHistogram::BUCKET_N; ++i) {
+            auto count = histogram.counts[i].load(std::memory_order_relaxed);
+            if (count == 0)
+                continue;
+            out << (first ? "" : ", ") << "{\"upper_ms\": " << static_cast<f64>(DurationHistogram::upper_bound_of(i)) * 1e-3 << ", \"count\": " << count << "}";
+            first = false;
+        }
+        out << "]\n}\n";
+        return static_cast<bool>(out);
+    }
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+// The GL entry points the state cache forwards to. A different backend
+// with the same member functions (RecordingGlApi below, NullGlApi in
+// command_list.hpp) can be plugged into BasicGlStateCache to exercise it
+// without a context.
+struct GlApi {
+    void enable(GLenum cap, bool on) {
+        if (on)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+    void depth_func(GLenum func) {
+        glDepthFunc(func);
+    }
+    void blend_func(GLenum src, GLenum dst) {
+        glBlendFunc(src, dst);
+    }
+    void viewport(i32 x, i32 y, i32 w, i32 h) {
+        glViewport(x, y, w, h);
+    }
+    void clear_color(f32 r, f32 g, f32 b, f32 a) {
+        glClearColor(r, g, b, a);
+    }
+    void clear_depth(f64 depth) {
+        glClearDepth(depth);
+    }
+    void use_program(u32 id) {
+        glUseProgram(id);
+    }
+    void bind_vertex_array(u32 id) {
+        glBindVertexArray(id);
+    }
+    void bind_buffer(GLenum target, u32 id) {
+        glBindBuffer(target, id);
+    }
+    // size 0 binds the whole buffer
+    void bind_buffer_range(GLenum target, u32 index, u32 id, size_t offset, size_t size) {
+        if (size == 0)
+            glBindBufferBase(target, index, id);
+        else
+            glBindBufferRange(target, index, id, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+    }
+    void bind_texture_unit(u32 unit, u32 id) {
+        glBindTextureUnit(unit, id);
+    }
+};
+
+// Records which calls reach GL instead of making them, so the filtering of
+// BasicGlStateCache can be checked without a context.
+struct RecordingGlApi {
+    enum class Call {
+        Enable,
+        DepthFunc,
+        BlendFunc,
+        Viewport,
+        ClearColor,
+        ClearDepth,
+        UseProgram,
+        BindVertexArray,
+        BindBuffer,
+        BindBufferRange,
+        BindTextureUnit,
+    };
+
+    std::vector<Call> calls;
+
+    void enable(GLenum, bool) {
+        calls.push_back(Call::Enable);
+    }
+    void depth_func(GLenum) {
+        calls.push_back(Call::DepthFunc);
+    }
+    void blend_func(GLenum, GLenum) {
+        calls.push_back(Call::BlendFunc);
+    }
+    void viewport(i32, i32, i32, i32) {
+        calls.push_back(Call::Viewport);
+    }
+    void clear_color(f32, f32, f32, f32) {
+        calls.push_back(Call::ClearColor);
+    }
+    void clear_depth(f64) {
+        calls.push_back(Call::ClearDepth);
+    }
+    void use_program(u32) {
+        calls.push_back(Call::UseProgram);
+    }
+    void bind_vertex_array(u32) {
+        calls.push_back(Call::BindVertexArray);
+    }
+    void bind_buffer(GLenum, u32) {
+        calls.push_back(Call::BindBuffer);
+    }
+    void bind_buffer_range(GLenum, u32, u32, size_t, size_t) {
+        calls.push_back(Call::BindBufferRange);
+    }
+    void bind_texture_unit(u32, u32) {
+        calls.push_back(Call::BindTextureUnit);
+    }
+
+    size_t count(Call call) const {
+        return static_cast<size_t>(std::count(calls.begin(), calls.end(), call));
+    }
+};
+
+// Shadow copy of the GL state the samples touch, so that setting a value
+// that is already current costs nothing. State starts out unknown (the
+// first set always goes through), and `invalidate` returns to that for
+// code that changes GL state behind the cache's back. Deleting a GL
+// object while it is bound silently unbinds it, so owners call the
+// matching `forget_*` before deleting.
+//
+// All calls must come from the thread that owns the context.
+template <typename Api>
+struct BasicGlStateCache {
+    static constexpr u32 UNKNOWN = std::numeric_limits<u32>::max();
+    static constexpr size_t INDEXED_BINDING_N = 16;
+    static constexpr size_t TEXTURE_UNIT_N = 32;
+
+    struct Stats {
+        u64 issued_n = 0;
+        u64 filtered_n = 0;
+    };
+
+    Api api;
+    // since the last `end_frame`, and for the frame before that
+    Stats stats, last_frame_stats;
+
+    BasicGlStateCache() {
+        invalidate();
+    }
+
+    void invalidate() {
+        caps.clear();
+        depth_func_value = UNKNOWN;
+        blend_src = blend_dst = UNKNOWN;
+        viewport_known = clear_color_known = clear_depth_known = false;
+        program = vertex_array = UNKNOWN;
+        buffers.clear();
+        indexed_buffers.clear();
+        texture_units.fill(UNKNOWN);
+    }
+
+    void end_frame() {
+        last_frame_stats = stats;
+        stats = {};
+    }
+
+    void enable(GLenum cap, bool on = true) {
+        auto it = std::find_if(caps.begin(), caps.end(), [cap](const auto &c) { return c.first == cap; });
+        if (it != caps.end() && it->second == on)
+            return filtered();
+        if (it != caps.end())
+            it->second = on;
+        else
+            caps.push_back({cap, on});
+        issued();
+        api.enable(cap, on);
+    }
+    void disable(GLenum cap) {
+        enable(cap, false);
+    }
+
+    void depth_func(GLenum func) {
+        if (depth_func_value == func)
+            return filtered();
+        depth_func_value = func;
+        issued();
+        api.depth_func(func);
+    }
+
+    void blend_func(GLenum src, GLenum dst) {
+        if (blend_src == src && blend_dst == dst)
+            return filtered();
+        blend_src = src, blend_dst = dst;
+        issued();
+        api.blend_func(src, dst);
+    }
+
+    void viewport(i32 x, i32 y, i32 w, i32 h) {
+        std::array<i32, 4> value = {x, y, w, h};
+        if (viewport_known && viewport_value == value)
+            return filtered();
+        viewport_known = true, viewport_value = value;
+        issued();
+        api.viewport(x, y, w, h);
+    }
+
+    void clear_color(f32 r, f32 g, f32 b, f32 a) {
+        std::array<f32, 4> value = {r, g, b, a};
+        if (clear_color_known && clear_color_value == value)
+            return filtered();
+        clear_color_known = true, clear_color_value = value;
+        issued();
+        api.clear_color(r, g, b, a);
+    }
+
+    void clear_depth(f64 depth) {
+        if (clear_depth_known && clear_depth_value == depth)
+            return filtered();
+        clear_depth_known = true, clear_depth_value = depth;
+        issued();
+        api.clear_depth(depth);
+    }
+
+    void use_program(u32 id) {
+        if (program == id)
+            return filtered();
+        program = id;
+        issued();
+        api.use_program(id);
+    }
+
+    void bind_vertex_array(u32 id) {
+        if (vertex_array == id)
+            return filtered();
+        vertex_array = id;
+        // the element array binding is VAO state
+        forget_buffer_target(GL_ELEMENT_ARRAY_BUFFER);
+        issued();
+        api.bind_vertex_array(id);
+    }
+
+    void bind_buffer(GLenum target, u32 id) {
+        auto it = std::find_if(buffers.begin(), buffers.end(), [target](const auto &b) { return b.first == target; });
+        if (it != buffers.end() && it->second == id)
+            return filtered();
+        if (it != buffers.end())
+            it->second = id;
+        else
+            buffers.push_back({target, id});
+        issued();
+        api.bind_buffer(target, id);
+    }
+
+    // GL also rebinds the generic `target` here, so that is forgotten.
+    void bind_buffer_range(GLenum target, u32 index, u32 id, size_t offset = 0, size_t size = 0) {
+        if (index >= INDEXED_BINDING_N) {
+            forget_buffer_target(target);
+            issued();
+            return api.bind_buffer_range(target, index, id, offset, size);
+        }
+        auto it = std::find_if(indexed_buffers.begin(), indexed_buffers.end(), [target](const auto &b) { return b.target == target; });
+        if (it == indexed_buffers.end()) {
+            IndexedTarget entry{target, {}};
+            entry.bindings.fill({UNKNOWN, 0, 0});
+            indexed_buffers.push_back(entry);
+            it = indexed_buffers.end() - 1;
+        }
+        auto &binding = it->bindings[index];
+        if (binding.id == id && binding.offset == offset && binding.size == size)
+            return filtered();
+        binding = {id, offset, size};
+        forget_buffer_target(target);
+        issued();
+        api.bind_buffer_range(target, index, id, offset, size);
+    }
+
+    void bind_texture_unit(u32 unit, u32 id) {
+        if (unit < TEXTURE_UNIT_N && texture_units[unit] == id)
+            return filtered();
+        if (unit < TEXTURE_UNIT_N)
+            texture_units[unit] = id;
+        issued();
+        api.bind_texture_unit(unit, id);
+    }
+
+    void forget_program(u32 id) {
+        if (program == id)
+            program = UNKNOWN;
+    }
+    void forget_vertex_array(u32 id) {
+        if (vertex_array == id)
+            vertex_array = UNKNOWN;
+    }
+    void forget_buffer(u32 id) {
+        for (auto &b : buffers) {
+            if (b.second == id)
+                b.second = UNKNOWN;
+        }
+        for (auto &indexed : indexed_buffers) {
+            for (auto &binding : indexed.bindings) {
+                if (binding.id == id)
+                    binding.id = UNKNOWN;
+            }
+        }
+    }
+    void forget_texture(u32 id) {
+        for (auto &unit : texture_units) {
+            if (unit == id)
+                unit = UNKNOWN;
+        }
+    }
+
+  private:
+    struct IndexedBinding {
+        u32 id;
+        size_t offset, size;
+    };
+    struct IndexedTarget {
+        GLenum target;
+        std::array<IndexedBinding, INDEXED_BINDING_N> bindings;
+    };
+
+    std::vector<std::pair<GLenum, bool>> caps;
+    GLenum depth_func_value;
+    GLenum blend_src, blend_dst;
+    bool viewport_known, clear_color_known, clear_depth_known;
+    std::array<i32, 4> viewport_value;
+    std::array<f32, 4> clear_color_value;
+    f64 clear_depth_value;
+    u32 program, vertex_array;
+    std::vector<std::pair<GLenum, u32>> buffers;
+    std::vector<IndexedTarget> indexed_buffers;
+    std::array<u32, TEXTURE_UNIT_N> texture_units;
+
+    void issued() {
+        ++stats.issued_n;
+    }
+    void filtered() {
+        ++stats.filtered_n;
+    }
+    void forget_buffer_target(GLenum target) {
+        for (auto &b : buffers) {
+            if (b.first == target)
+                b.second = UNKNOWN;
+        }
+    }
+};
+
+using GlStateCache = BasicGlStateCache<GlApi>;
+
+// The samples use a single context, so one cache serves everything.
+inline GlStateCache &gl_state() {
+    static GlStateCache instance;
+    return instance;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "profiler.hpp"
+
+// GL timestamp queries around passes, reported on the profiler's GPU
+// track. A frame's queries are read back when its slot comes round again,
+// FRAME_N - 1 frames later, by which time they have almost always landed,
+// so timing never stalls the pipeline; frames whose results are still
+// missing then are dropped.
+//
+//     {
+//         GPU_PROFILE_SCOPE("scene");
+//         scene.draw();
+//     }
+//     gpu_timer().end_frame();
+//
+// Must be used on the thread that owns the context.
+struct GpuTimer {
+    static constexpr size_t FRAME_N = 4;
+    static constexpr size_t MAX_SCOPES = 64;
+
+    struct Frame {
+        std::array<u32, MAX_SCOPES * 2> queries{};
+        std::array<const char *, MAX_SCOPES> names{};
+        std::array<u32, MAX_SCOPES> depths{};
+        u32 scope_n = 0;
+        u64 frame = 0;
+    };
+
+    std::array<Frame, FRAME_N> frames;
+    size_t frame_i = 0;
+    u32 depth = 0;
+    // GPU timestamp + offset = profiler time
+    i64 offset_ns = 0;
+    // newest frame whose results reached the GPU track
+    u64 resolved_frame = 0;
+    u32 dropped_n = 0;
+
+    GpuTimer() {
+        for (auto &frame : frames)
+            glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        GLint64 gpu_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        offset_ns = static_cast<i64>(profiler().now_ns()) - gpu_now;
+        frames[frame_i].frame = profiler().frame.load();
+    }
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    ~GpuTimer() {
+        for (auto &frame : frames)
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+    }
+
+    // Returns the scope index for `end`, or MAX_SCOPES when the frame is
+    // full (which `end` ignores).
+    u32 begin(const char *name) {
+        auto &frame = frames[frame_i];
+        if (frame.scope_n == MAX_SCOPES)
+            return static_cast<u32>(MAX_SCOPES);
+        auto i = frame.scope_n++;
+        frame.names[i] = name;
+        frame.depths[i] = depth++;
+        glQueryCounter(frame.queries[i * 2], GL_TIMESTAMP);
+        return i;
+    }
+
+    void end(u32 scope_i) {
+        if (scope_i >= MAX_SCOPES)
+            return;
+        --depth;
+        glQueryCounter(frames[frame_i].queries[scope_i * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // Call once per frame, after the frame's last scope.
+    void end_frame() {
+        frame_i = (frame_i + 1) % FRAME_N;
+        auto &frame = frames[frame_i];
+        if (frame.scope_n > 0)
+            resolve(frame);
+        frame.scope_n = 0;
+        frame.frame = profiler().frame.load();
+    }
+
+  private:
+    void resolve(const Frame &frame) {
+        for (u32 i = 0; i < frame.scope_n; ++i) {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(frame.queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available != GL_TRUE) {
+                ++dropped_n;
+                return;
+            }
+        }
+        auto &track = profiler().gpu_track();
+        for (u32 i = 0; i < frame.scope_n; ++i) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            auto to_profiler_ns = [&](GLuint64 t) {
+                return static_cast<u64>(std::max<i64>(static_cast<i64>(t) + offset_ns, 0));
+            };
+            track.push({frame.names[i], to_profiler_ns(begin), to_profiler_ns(end), frame.frame, frame.depths[i]});
+        }
+        resolved_frame = frame.frame;
+    }
+};
+
+// Created on first use, which must be after GL is loaded.
+inline GpuTimer &gpu_timer() {
+    static GpuTimer instance;
+    return instance;
+}
+
+struct GpuProfileScope {
+    u32 scope_i;
+
+    GpuProfileScope(const char *name) : scope_i(gpu_timer().begin(name)) {}
+
+    GpuProfileScope(const GpuProfileScope &) = delete;
+    GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+    ~GpuProfileScope() {
+        gpu_timer().end(scope_i);
+    }
+};
+
+// Times the enclosing scope on both the CPU and the GPU.
+#define GPU_PROFILE_SCOPE(name)                                                  \
+    PROFILE_SCOPE(name);                                                         \
+    GpuProfileScope PROFILE_CONCAT(gpu_profile_scope_, __LINE__)(name)
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#if COEL_SAMPLES_USE_EGL
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// Tightly packed 8-bit RGB, top row first, stored on disk as binary PPM
+// so goldens need no image library to read or write.
+struct RgbImage {
+    u32 size_x = 0, size_y = 0;
+    std::vector<u8> pixels;
+
+    bool is_valid() const {
+        return size_x > 0 && size_y > 0 && pixels.size() == size_t{size_x} * size_y * 3;
+    }
+};
+
+inline bool write_ppm(const std::filesystem::path &path, const RgbImage &image) {
+    std::error_code ec;
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path(), ec);
+    auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "ERROR::HEADLESS::could not write " << path.string() << std::endl;
+        return false;
+    }
+    out << "P6\n" << image.size_x << ' ' << image.size_y << "\n255\n";
+    out.write(reinterpret_cast<const char *>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+    return static_cast<bool>(out);
+}
+
+// Only what write_ppm produces: P6, maxval 255, no comments.
+inline RgbImage read_ppm(const std::filesystem::path &path) {
+    RgbImage result;
+    auto in = std::ifstream(path, std::ios::binary);
+    std::string magic;
+    u32 max_value = 0;
+    if (!(in >> magic >> result.size_x >> result.size_y >> max_value) || magic != "P6" || max_value != 255) {
+        result = {};
+        return result;
+    }
+    in.get();
+    result.pixels.resize(size_t{result.size_x} * result.size_y * 3);
+    if (!in.read(reinterpret_cast<char *>(result.pixels.data()), static_cast<std::streamsize>(result.pixels.size())))
+        result = {};
+    return result;
+}
+
+struct ImageDiff {
+    bool size_matches = false;
+    // largest per-channel difference
+    u32 max_difference = 0;
+    // pixels with a channel differing by more than the tolerance
+    u64 differing_n = 0;
+    f64 differing_fraction = 0.0;
+};
+
+// Rasterisers may differ slightly in coverage and rounding, so a channel
+// within `tolerance` counts as equal; callers then bound the fraction of
+// pixels that still differ.
+inline ImageDiff compare_images(const RgbImage &a, const RgbImage &b, u32 tolerance) {
+    ImageDiff result;
+    if (a.size_x != b.size_x || a.size_y != b.size_y || !a.is_valid() || !b.is_valid())
+        return result;
+    result.size_matches = true;
+    size_t pixel_n = size_t{a.size_x} * a.size_y;
+    for (size_t i = 0; i < pixel_n; ++i) {
+        u32 pixel_max = 0;
+        for (size_t c = 0; c < 3; ++c) {
+            auto d = static_cast<u32>(std::abs(static_cast<i32>(a.pixels[i * 3 + c]) - static_cast<i32>(b.pixels[i * 3 + c])));
+            pixel_max = std::max(pixel_max, d);
+        }
+        result.max_difference = std::max(result.max_difference, pixel_max);
+        if (pixel_max > tolerance)
+            ++result.differing_n;
+    }
+    result.differing_fraction = static_cast<f64>(result.differing_n) / static_cast<f64>(pixel_n);
+    return result;
+}
+
+// Reads the bound read framebuffer's colour, with the rows flipped to
+// top-down.
+inline RgbImage read_framebuffer(u32 size_x, u32 size_y) {
+    RgbImage result{size_x, size_y, std::vector<u8>(size_t{size_x} * size_y * 3)};
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, static_cast<GLsizei>(size_x), static_cast<GLsizei>(size_y), GL_RGB, GL_UNSIGNED_BYTE, result.pixels.data());
+    size_t row = size_t{size_x} * 3;
+    std::vector<u8> temp(row);
+    for (u32 y = 0; y < size_y / 2; ++y) {
+        auto *top = result.pixels.data() + y * row, *bottom = result.pixels.data() + (size_y - 1 - y) * row;
+        std::memcpy(temp.data(), top, row);
+        std::memcpy(top, bottom, row);
+        std::memcpy(bottom, temp.data(), row);
+    }
+    return result;
+}
+
+// Colour + depth framebuffer to render into instead of the window, so the
+// result doesn't depend on window size, scaling or compositor.
+struct OffscreenTarget {
+    u32 size_x, size_y;
+    u32 fbo_id = 0;
+    u32 color_id = 0, depth_id = 0;
+
+    OffscreenTarget(u32 size_x_, u32 size_y_) : size_x(size_x_), size_y(size_y_) {
+        glCreateFramebuffers(1, &fbo_id);
+        glCreateRenderbuffers(1, &color_id);
+        glCreateRenderbuffers(1, &depth_id);
+        glNamedRenderbufferStorage(color_id, GL_RGBA8, static_cast<GLsizei>(size_x), static_cast<GLsizei>(size_y));
+        glNamedRenderbufferStorage(depth_id, GL_DEPTH_COMPONENT24, static_cast<GLsizei>(size_x), static_cast<GLsizei>(size_y));
+        glNamedFramebufferRenderbuffer(fbo_id, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_id);
+        glNamedFramebufferRenderbuffer(fbo_id, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_id);
+        auto status = glCheckNamedFramebufferStatus(fbo_id, GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::HEADLESS::offscreen framebuffer incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+    }
+
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    ~OffscreenTarget() {
+        glDeleteFramebuffers(1, &fbo_id);
+        glDeleteRenderbuffers(1, &color_id);
+        glDeleteRenderbuffers(1, &depth_id);
+    }
+
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+    }
+
+    // Waits for rendering to finish.
+    RgbImage read() const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_id);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        auto result = read_framebuffer(size_x, size_y);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return result;
+    }
+};
+
+#if COEL_SAMPLES_USE_EGL
+// A GL 4.6 core context with no window and no surface, through Mesa's
+// surfaceless EGL platform, so the headless runner needs no display
+// server. Draw into an OffscreenTarget; there is no default framebuffer.
+struct SurfacelessGlContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    // Leaves the context invalid, with the reason printed, if the
+    // platform or a 4.6 core context isn't available.
+    SurfacelessGlContext() {
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        EGLint egl_major = 0, egl_minor = 0;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor) || !eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "ERROR::HEADLESS::no surfaceless EGL display (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return;
+        }
+        const EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 6,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE,
+        };
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+        if (context != EGL_NO_CONTEXT && !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        if (context == EGL_NO_CONTEXT) {
+            std::cout << "ERROR::HEADLESS::could not create a GL 4.6 core context (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return;
+        }
+        gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+    }
+
+    SurfacelessGlContext(const SurfacelessGlContext &) = delete;
+    SurfacelessGlContext &operator=(const SurfacelessGlContext &) = delete;
+
+    ~SurfacelessGlContext() {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    bool is_valid() const {
+        return context != EGL_NO_CONTEXT;
+    }
+};
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include "culling.hpp"
+
+// Per-instance data for the common case of many copies of one mesh that
+// differ only in placement and colour.
+struct InstanceData {
+    f32mat4 modl_mat;
+    f32vec4 col;
+};
+
+// CPU-side instances of one mesh, with their world bounds. Each frame
+// `cull` packs the ones inside the frustum, in order, into a contiguous
+// array ready for Mesh::set_instance_data, so a thousand props cost one
+// upload and one instanced draw instead of a draw each.
+//
+// `T` is whatever the instance stream holds (InstanceData by default).
+template <typename T = InstanceData>
+struct InstanceBatch {
+    std::vector<T> instances;
+    BoundsSoA bounds;
+    std::vector<T> visible_instances;
+    std::vector<u8> visible;
+    CullStats stats;
+
+    size_t size() const {
+        return instances.size();
+    }
+
+    void clear() {
+        instances.clear();
+        bounds.resize(0);
+    }
+
+    // `bounds_min`/`bounds_max` are the mesh's model-space AABB.
+    void add(const T &instance, const f32mat4 &modl_mat, f32vec3 bounds_min, f32vec3 bounds_max) {
+        instances.push_back(instance);
+        bounds.push_back(modl_mat, bounds_min, bounds_max);
+    }
+
+    void set(size_t i, const T &instance, const f32mat4 &modl_mat, f32vec3 bounds_min, f32vec3 bounds_max) {
+        instances[i] = instance;
+        bounds.set(i, modl_mat, bounds_min, bounds_max);
+    }
+
+    std::span<const T> cull(const f32mat4 &view_proj) {
+        auto n = instances.size();
+        visible.resize(n);
+        frustum_cull(Frustum(view_proj), bounds, visible);
+        visible_instances.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (visible[i])
+                visible_instances.push_back(instances[i]);
+        }
+        stats = {};
+        stats.total_n = static_cast<u32>(n);
+        stats.visible_n = static_cast<u32>(visible_instances.size());
+        stats.frustum_culled_n = stats.total_n - stats.visible_n;
+        return visible_instances;
+    }
+};
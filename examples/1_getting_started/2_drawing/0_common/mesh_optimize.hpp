@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+// Import-time index/vertex reordering for triangle lists. The intended
+// order of passes is weld -> vertex cache -> overdraw -> vertex fetch,
+// which is what `optimize_mesh` runs.
+namespace mesh_optimize {
+    static constexpr size_t CACHE_SIZE = 16;
+
+    struct CacheStats {
+        size_t triangle_n = 0;
+        size_t vertex_n = 0; // referenced vertices
+        size_t miss_n = 0;
+
+        // post-transform cache misses per triangle
+        f32 acmr() const {
+            return triangle_n ? static_cast<f32>(miss_n) / static_cast<f32>(triangle_n) : 0.0f;
+        }
+        // cache misses per referenced vertex (1.0 is ideal)
+        f32 atvr() const {
+            return vertex_n ? static_cast<f32>(miss_n) / static_cast<f32>(vertex_n) : 0.0f;
+        }
+
+        CacheStats &operator+=(const CacheStats &other) {
+            triangle_n += other.triangle_n;
+            vertex_n += other.vertex_n;
+            miss_n += other.miss_n;
+            return *this;
+        }
+    };
+
+    // Simulates a FIFO post-transform cache of `cache_size` entries.
+    inline CacheStats analyze_vertex_cache(std::span<const u32> indices, size_t vertex_n, size_t cache_size = CACHE_SIZE) {
+        CacheStats result;
+        // Each vertex remembers the miss counter value at which it entered
+        // the FIFO; it is still cached while fewer than cache_size misses
+        // have happened since.
+        std::vector<size_t> entered_at(vertex_n, 0);
+        std::vector<bool> referenced(vertex_n, false);
+        size_t misses = 0, unique_n = 0;
+        for (auto i : indices) {
+            if (!referenced[i]) {
+                referenced[i] = true;
+                ++unique_n;
+            } else if (misses - entered_at[i] < cache_size) {
+                continue;
+            }
+            ++misses;
+            entered_at[i] = misses;
+        }
+        result.triangle_n = indices.size() / 3;
+        result.vertex_n = unique_n;
+        result.miss_n = misses;
+        return result;
+    }
+
+    // Merges bitwise-identical vertices, rewriting `indices` in place.
+    // Returns the new vertex count; the unique vertices are compacted to
+    // the front of `vertices`.
+    template <typename Vertex>
+    size_t weld_vertices(std::span<Vertex> vertices, std::span<u32> indices) {
+        static_assert(std::is_trivially_copyable_v<Vertex>);
+        if (vertices.empty())
+            return 0;
+        auto hash_vertex = [](const Vertex &v) {
+            u64 hash = 0xcbf29ce484222325;
+            auto bytes = reinterpret_cast<const u8 *>(&v);
+            for (size_t i = 0; i < sizeof(Vertex); ++i) {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3;
+            }
+            return hash;
+        };
+        size_t table_size = std::bit_ceil(vertices.size() * 2);
+        constexpr u32 EMPTY = std::numeric_limits<u32>::max();
+        std::vector<u32> table(table_size, EMPTY);
+        std::vector<u32> remap(vertices.size());
+        u32 unique_n = 0;
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            size_t slot = hash_vertex(vertices[i]) & (table_size - 1);
+            while (table[slot] != EMPTY && std::memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+                slot = (slot + 1) & (table_size - 1);
+            if (table[slot] == EMPTY) {
+                vertices[unique_n] = vertices[i];
+                table[slot] = unique_n++;
+            }
+            remap[i] = table[slot];
+        }
+        for (auto &i : indices)
+            i = remap[i];
+        return unique_n;
+    }
+
+    // Tipsify (Sander, Nehab, Barczak 2007): greedy fanning around the
+    // most recently cached vertex, with a dead-end stack to recover when
+    // the current fan runs out of triangles. Linear time.
+    inline std::vector<u32> optimize_vertex_cache(std::span<const u32> indices, size_t vertex_n, size_t cache_size = CACHE_SIZE) {
+        size_t tri_n = indices.size() / 3;
+        std::vector<u32> result;
+        result.reserve(tri_n * 3);
+        if (tri_n == 0)
+            return result;
+
+        std::vector<u32> live(vertex_n, 0);
+        for (auto i : indices)
+            ++live[i];
+        std::vector<u32> adj_offsets(vertex_n + 1, 0);
+        std::partial_sum(live.begin(), live.end(), adj_offsets.begin() + 1);
+        std::vector<u32> adj(indices.size());
+        {
+            auto cursor = adj_offsets;
+            for (size_t t = 0; t < tri_n; ++t)
+                for (size_t k = 0; k < 3; ++k)
+                    adj[cursor[indices[t * 3 + k]]++] = static_cast<u32>(t);
+        }
+
+        std::vector<size_t> cache_time(vertex_n, 0);
+        std::vector<bool> emitted(tri_n, false);
+        std::vector<u32> dead_end;
+        std::vector<u32> candidates;
+        size_t time = cache_size + 1;
+        size_t cursor = 0;
+
+        auto skip_dead_end = [&]() -> i64 {
+            while (!dead_end.empty()) {
+                auto d = dead_end.back();
+                dead_end.pop_back();
+                if (live[d] > 0)
+                    return d;
+            }
+            for (; cursor < vertex_n; ++cursor) {
+                if (live[cursor] > 0)
+                    return static_cast<i64>(cursor);
+            }
+            return -1;
+        };
+
+        i64 fan = skip_dead_end();
+        while (fan >= 0) {
+            candidates.clear();
+            auto f = static_cast<size_t>(fan);
+            for (u32 a = adj_offsets[f]; a < adj_offsets[f + 1]; ++a) {
+                auto t = adj[a];
+                if (emitted[t])
+                    continue;
+                for (size_t k = 0; k < 3; ++k) {
+                    auto v = indices[t * 3 + k];
+                    result.push_back(v);
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - cache_time[v] > cache_size)
+                        cache_time[v] = time++;
+                }
+                emitted[t] = true;
+            }
+            // Prefer the candidate that stays in cache the longest while
+            // its remaining fan still fits.
+            i64 best = -1;
+            i64 best_priority = -1;
+            for (auto v : candidates) {
+                if (live[v] == 0)
+                    continue;
+                i64 priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                    priority = static_cast<i64>(time - cache_time[v]);
+                if (priority > best_priority) {
+                    best_priority = priority;
+                    best = v;
+                }
+            }
+            fan = best >= 0 ? best : skip_dead_end();
+        }
+        return result;
+    }
+
+    // Splits the cache-optimised triangle order into clusters at points
+    // where the cache restarts, then sorts the clusters so that the ones
+    // facing away from the mesh centre (which tend to occlude the rest)
+    // are drawn first. Only cluster order changes, so the cache behaviour
+    // within each cluster is preserved.
+    inline void optimize_overdraw(std::span<u32> indices, size_t vertex_n, auto &&get_pos, size_t cache_size = CACHE_SIZE) {
+        size_t tri_n = indices.size() / 3;
+        if (tri_n < 2)
+            return;
+
+        static constexpr size_t MIN_CLUSTER_TRIS = 16;
+        std::vector<size_t> cluster_starts = {0};
+        {
+            std::vector<size_t> entered_at(vertex_n, 0);
+            std::vector<bool> referenced(vertex_n, false);
+            size_t misses = 0;
+            for (size_t t = 0; t < tri_n; ++t) {
+                size_t tri_misses = 0;
+                for (size_t k = 0; k < 3; ++k) {
+                    auto v = indices[t * 3 + k];
+                    if (referenced[v] && misses - entered_at[v] < cache_size)
+                        continue;
+                    referenced[v] = true;
+                    entered_at[v] = ++misses;
+                    ++tri_misses;
+                }
+                if (tri_misses == 3 && t - cluster_starts.back() >= MIN_CLUSTER_TRIS)
+                    cluster_starts.push_back(t);
+            }
+        }
+        size_t cluster_n = cluster_starts.size();
+        if (cluster_n < 2)
+            return;
+        cluster_starts.push_back(tri_n);
+
+        f32 mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+        for (size_t i = 0; i < vertex_n; ++i) {
+            auto p = get_pos(i);
+            for (size_t k = 0; k < 3; ++k)
+                mesh_centroid[k] += p[k];
+        }
+        for (size_t k = 0; k < 3; ++k)
+            mesh_centroid[k] /= static_cast<f32>(vertex_n);
+
+        std::vector<f32> sort_keys(cluster_n);
+        for (size_t c = 0; c < cluster_n; ++c) {
+            f32 centroid[3] = {0.0f, 0.0f, 0.0f};
+            f32 normal[3] = {0.0f, 0.0f, 0.0f};
+            f32 area_sum = 0.0f;
+            for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; ++t) {
+                auto p0 = get_pos(indices[t * 3 + 0]);
+                auto p1 = get_pos(indices[t * 3 + 1]);
+                auto p2 = get_pos(indices[t * 3 + 2]);
+                f32 e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                f32 e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                f32 n[3] = {
+                    e0[1] * e1[2] - e0[2] * e1[1],
+                    e0[2] * e1[0] - e0[0] * e1[2],
+                    e0[0] * e1[1] - e0[1] * e1[0],
+                };
+                f32 area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (size_t k = 0; k < 3; ++k) {
+                    centroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+                    normal[k] += n[k];
+                }
+                area_sum += area;
+            }
+            f32 key = 0.0f;
+            if (area_sum > 0.0f) {
+                f32 normal_len = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                if (normal_len > 0.0f) {
+                    for (size_t k = 0; k < 3; ++k)
+                        key += (centroid[k] / area_sum - mesh_centroid[k]) * (normal[k] / normal_len);
+                }
+            }
+            sort_keys[c] = key;
+        }
+
+        std::vector<size_t> cluster_order(cluster_n);
+        std::iota(cluster_order.begin(), cluster_order.end(), size_t{0});
+        std::stable_sort(cluster_order.begin(), cluster_order.end(), [&](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+        std::vector<u32> result;
+        result.reserve(indices.size());
+        for (auto c : cluster_order)
+            result.insert(result.end(), indices.begin() + static_cast<std::ptrdiff_t>(cluster_starts[c] * 3), indices.begin() + static_cast<std::ptrdiff_t>(cluster_starts[c + 1] * 3));
+        std::copy(result.begin(), result.end(), indices.begin());
+    }
+
+    // Reorders vertices into first-use order so the vertex fetch walks
+    // memory linearly. Unreferenced vertices are dropped; returns the new
+    // vertex count.
+    template <typename Vertex>
+    size_t optimize_vertex_fetch(std::span<Vertex> vertices, std::span<u32> indices) {
+        constexpr u32 UNUSED = std::numeric_limits<u32>::max();
+        std::vector<u32> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+        for (auto &i : indices) {
+            if (remap[i] == UNUSED) {
+                remap[i] = static_cast<u32>(result.size());
+                result.push_back(vertices[i]);
+            }
+            i = remap[i];
+        }
+        std::copy(result.begin(), result.end(), vertices.begin());
+        return result.size();
+    }
+
+    struct OptimizeResult {
+        size_t vertex_n = 0;
+        CacheStats before{}, after{};
+    };
+
+    // Runs every pass on one triangle list in place and returns the new
+    // vertex count (the first `vertex_n` entries of `vertices` are valid).
+    template <typename Vertex>
+    OptimizeResult optimize_mesh(std::span<Vertex> vertices, std::span<u32> indices) {
+        OptimizeResult result{.vertex_n = vertices.size()};
+        result.before = analyze_vertex_cache(indices, vertices.size());
+        if (indices.size() < 3) {
+            result.after = result.before;
+            return result;
+        }
+        auto vertex_n = weld_vertices(vertices, indices);
+        auto welded = vertices.first(vertex_n);
+        auto reordered = optimize_vertex_cache(indices, vertex_n);
+        std::copy(reordered.begin(), reordered.end(), indices.begin());
+        optimize_overdraw(indices, vertex_n, [&](size_t i) { return welded[i].pos; });
+        result.vertex_n = optimize_vertex_fetch(welded, indices);
+        result.after = analyze_vertex_cache(indices, result.vertex_n);
+        return result;
+    }
+} // namespace mesh_optimize
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+// Quadric error metric simplification (Garland & Heckbert 1997) using
+// half-edge collapses, so simplified index lists keep referencing the
+// original vertices and an LOD is just another index range.
+namespace mesh_simplify {
+    // Symmetric 4x4 plane quadric, stored as its 10 unique entries, plus
+    // the total area it was accumulated over.
+    struct Quadric {
+        f64 a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+        f64 ab = 0, ac = 0, ad = 0, bc = 0, bd = 0, cd = 0;
+        f64 weight = 0;
+
+        static Quadric from_plane(f64 a, f64 b, f64 c, f64 d, f64 weight) {
+            return {
+                .a2 = a * a * weight,
+                .b2 = b * b * weight,
+                .c2 = c * c * weight,
+                .d2 = d * d * weight,
+                .ab = a * b * weight,
+                .ac = a * c * weight,
+                .ad = a * d * weight,
+                .bc = b * c * weight,
+                .bd = b * d * weight,
+                .cd = c * d * weight,
+                .weight = weight,
+            };
+        }
+
+        Quadric &operator+=(const Quadric &o) {
+            a2 += o.a2, b2 += o.b2, c2 += o.c2, d2 += o.d2;
+            ab += o.ab, ac += o.ac, ad += o.ad, bc += o.bc, bd += o.bd, cd += o.cd;
+            weight += o.weight;
+            return *this;
+        }
+
+        // Area-weighted mean squared distance of `p` to the planes.
+        f64 error(f32vec3 p) const {
+            f64 x = p[0], y = p[1], z = p[2];
+            f64 q = a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+                    2 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+            return weight > 0 ? std::max(q, 0.0) / weight : 0.0;
+        }
+    };
+
+    // Collapses edges of a triangle list until at most `target_index_n`
+    // indices remain or the next collapse would move the surface further
+    // than `max_error`. Vertices on open edges (including UV/normal seams,
+    // which are open edges in index space) are never moved, and collapses
+    // that would flip a triangle are rejected. Returns the new index list
+    // and writes the largest accepted error, in model-space units, to
+    // `result_error`.
+    inline std::vector<u32> simplify(std::span<const u32> indices, size_t vertex_n, auto &&get_pos, size_t target_index_n, f32 max_error, f32 *result_error = nullptr) {
+        std::vector<u32> result(indices.begin(), indices.end());
+        f64 error_reached = 0;
+        if (result.size() <= target_index_n || vertex_n == 0) {
+            if (result_error)
+                *result_error = 0.0f;
+            return result;
+        }
+
+        auto sub = [](f32vec3 a, f32vec3 b) { return f32vec3{a[0] - b[0], a[1] - b[1], a[2] - b[2]}; };
+        auto cross = [](f32vec3 a, f32vec3 b) {
+            return f32vec3{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+        };
+        auto dot = [](f32vec3 a, f32vec3 b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+
+        std::vector<Quadric> quadrics(vertex_n);
+        for (size_t t = 0; t + 2 < result.size(); t += 3) {
+            auto p0 = get_pos(result[t + 0]), p1 = get_pos(result[t + 1]), p2 = get_pos(result[t + 2]);
+            auto n = cross(sub(p1, p0), sub(p2, p0));
+            f64 len = std::sqrt(static_cast<f64>(dot(n, n)));
+            if (len == 0)
+                continue;
+            f64 a = n[0] / len, b = n[1] / len, c = n[2] / len;
+            f64 d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+            auto q = Quadric::from_plane(a, b, c, d, len * 0.5);
+            for (size_t k = 0; k < 3; ++k)
+                quadrics[result[t + k]] += q;
+        }
+
+        std::vector<u8> locked(vertex_n, 0);
+        {
+            std::unordered_map<u64, u32> edge_counts;
+            for (size_t t = 0; t + 2 < result.size(); t += 3) {
+                for (size_t k = 0; k < 3; ++k) {
+                    u32 a = result[t + k], b = result[t + (k + 1) % 3];
+                    ++edge_counts[(u64{std::min(a, b)} << 32) | std::max(a, b)];
+                }
+            }
+            for (auto [key, count] : edge_counts) {
+                if (count != 1)
+                    continue;
+                locked[key >> 32] = 1;
+                locked[key & 0xffffffff] = 1;
+            }
+        }
+
+        struct Collapse {
+            f32 error;
+            u32 from, to;
+        };
+        std::vector<Collapse> collapses;
+        std::vector<u32> remap(vertex_n);
+        std::vector<u8> touched(vertex_n);
+        std::vector<u32> adj_offsets(vertex_n + 1), adj;
+
+        while (result.size() > target_index_n) {
+            size_t tri_n = result.size() / 3;
+            // vertex -> triangle adjacency for the flip test
+            std::fill(adj_offsets.begin(), adj_offsets.end(), 0);
+            for (auto i : result)
+                ++adj_offsets[i + 1];
+            for (size_t i = 0; i < vertex_n; ++i)
+                adj_offsets[i + 1] += adj_offsets[i];
+            adj.resize(result.size());
+            {
+                auto cursor = adj_offsets;
+                for (size_t t = 0; t < tri_n; ++t)
+                    for (size_t k = 0; k < 3; ++k)
+                        adj[cursor[result[t * 3 + k]]++] = static_cast<u32>(t);
+            }
+
+            collapses.clear();
+            for (size_t t = 0; t < tri_n; ++t) {
+                for (size_t k = 0; k < 3; ++k) {
+                    u32 a = result[t * 3 + k], b = result[t * 3 + (k + 1) % 3];
+                    if (!locked[a])
+                        collapses.push_back({static_cast<f32>(std::sqrt(quadrics[a].error(get_pos(b)))), a, b});
+                    if (!locked[b])
+                        collapses.push_back({static_cast<f32>(std::sqrt(quadrics[b].error(get_pos(a)))), b, a});
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+            for (size_t i = 0; i < vertex_n; ++i)
+                remap[i] = static_cast<u32>(i);
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t removed_tri_n = 0;
+            size_t needed_tri_n = (result.size() - target_index_n + 2) / 3;
+            size_t collapse_n = 0;
+            for (const auto &c : collapses) {
+                if (c.error > max_error || removed_tri_n >= needed_tri_n)
+                    break;
+                if (touched[c.from] || touched[c.to])
+                    continue;
+                // reject if any surviving triangle around `from` flips
+                auto to_pos = get_pos(c.to);
+                bool flips = false;
+                size_t shared_n = 0;
+                for (u32 a = adj_offsets[c.from]; a < adj_offsets[c.from + 1] && !flips; ++a) {
+                    const u32 *tri = result.data() + adj[a] * 3;
+                    if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                        ++shared_n;
+                        continue;
+                    }
+                    f32vec3 p[3], q[3];
+                    for (size_t k = 0; k < 3; ++k) {
+                        p[k] = get_pos(tri[k]);
+                        q[k] = tri[k] == c.from ? to_pos : p[k];
+                    }
+                    auto n0 = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+                    auto n1 = cross(sub(q[1], q[0]), sub(q[2], q[0]));
+                    // also reject near-flips, which would compound over passes
+                    flips = dot(n0, n1) <= 0.25f * std::sqrt(dot(n0, n0) * dot(n1, n1));
+                }
+                if (flips)
+                    continue;
+                remap[c.from] = c.to;
+                quadrics[c.to] += quadrics[c.from];
+                // Everything sharing a triangle with `from` now has stale
+                // adjacency, so leave it alone until the next pass.
+                for (u32 a = adj_offsets[c.from]; a < adj_offsets[c.from + 1]; ++a)
+                    for (size_t k = 0; k < 3; ++k)
+                        touched[result[adj[a] * 3 + k]] = 1;
+                removed_tri_n += shared_n;
+                error_reached = std::max(error_reached, static_cast<f64>(c.error));
+                ++collapse_n;
+            }
+            if (collapse_n == 0)
+                break;
+
+            size_t out = 0;
+            for (size_t t = 0; t < tri_n; ++t) {
+                u32 a = remap[result[t * 3 + 0]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[out++] = a, result[out++] = b, result[out++] = c;
+            }
+            result.resize(out);
+        }
+        if (result_error)
+            *result_error = static_cast<f32>(error_reached);
+        return result;
+    }
+} // namespace mesh_simplify
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <span>
+#include <unordered_map>
 
 #include <cuiui/math/types.hpp>
 
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+#include "model_cache.hpp"
+#include "parallel.hpp"
+#include "scene_graph.hpp"
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
@@ -15,84 +26,370 @@ struct AssimpModelSource {
         f32vec2 tex;
     };
     using Index = uint32_t;
+    static constexpr size_t MAX_LOD_N = ModelCacheNode::MAX_LOD_N;
+    struct Lod {
+        std::span<const Index> indices;
+        // max deviation from the full-detail surface, in model-space units
+        f32 error;
+    };
     struct Node {
-        std::vector<Index> indices;
-        std::vector<Vertex> vertices;
+        // full-detail indices, same as lods[0]
+        std::span<const Index> indices;
+        std::span<const Vertex> vertices;
+        // world transform at import time; `scene_node` indexes the source's
+        // scene graph for the live hierarchy
         f32mat4 modl_mat;
+        u32 scene_node;
+        // index into `materials`
+        u32 material;
         // f32mat4 norm_mat;
+        // model-space AABB of `vertices`
+        f32vec3 bounds_min, bounds_max;
+        // Progressively simplified index lists into the same `vertices`,
+        // each roughly half the triangles of the previous one.
+        std::array<Lod, MAX_LOD_N> lods;
+        u32 lod_n;
+    };
+    struct MeshTask {
+        const aiNode *node;
+        const aiMesh *mesh;
+        u32 scene_node = 0;
+        size_t vertex_offset = 0, vertex_n = 0;
+        size_t index_offset = 0, index_n = 0;
     };
 
     std::filesystem::path path;
     std::vector<Node> nodes;
-    std::vector<Vertex> vertices;
-    std::vector<std::filesystem::path> albedo_texture_paths, normal_texture_paths;
+    // The full node hierarchy, including nodes without meshes. `nodes` is
+    // sorted by `scene_node`.
+    SceneGraph scene_graph;
+    // All node geometry lives in one contiguous vertex/index blob, owned
+    // either by the storage vectors (fresh import) or by the mapped cache file.
+    std::span<const Vertex> vertices;
+    std::span<const Index> indices;
+    std::vector<Vertex> vertex_storage;
+    std::vector<Index> index_storage;
+    MappedFile cache_file;
+    struct Material {
+        std::vector<std::filesystem::path> albedo_texture_paths, normal_texture_paths;
+    };
+    // one per aiScene material, in the same order
+    std::vector<Material> materials;
 
-    AssimpModelSource(const std::filesystem::path &path) : path(path) {
+    AssimpModelSource(const std::filesystem::path &path_) : path(path_) {
+        if (ModelCache::load(*this))
+            return;
         Assimp::Importer import;
         const aiScene *scene = import.ReadFile(path.string().c_str(), aiProcess_Triangulate | aiProcess_FlipUVs);
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
             return;
         }
-        process_node(scene->mRootNode, scene, path.parent_path());
+        process_scene(scene, path.parent_path());
+        ModelCache::store(*this);
     }
 
-    void process_node(aiNode *node, const aiScene *scene, const std::filesystem::path &root_dir);
+    AssimpModelSource(const AssimpModelSource &) = delete;
+    AssimpModelSource &operator=(const AssimpModelSource &) = delete;
+
+    size_t memory_size() const {
+        return vertices.size_bytes() + indices.size_bytes();
+    }
+
+    static std::vector<MeshTask> collect_mesh_tasks(const aiScene *scene, SceneGraph &scene_graph);
+    static void extract_mesh(const MeshTask &task, Vertex *vertex_dst, Index *index_dst);
+    void process_scene(const aiScene *scene, const std::filesystem::path &root_dir);
 };
 
-static std::vector<std::shared_ptr<AssimpModelSource>> model_sources;
+// Shared, thread-safe cache of loaded model sources keyed by the hash of
+// the canonical path. Concurrent requests for the same asset share one
+// load, and sources no longer referenced outside the cache are evicted in
+// LRU order once the loaded geometry exceeds `memory_budget`.
+struct ModelSourceCache {
+    using SourcePtr = std::shared_ptr<AssimpModelSource>;
+    struct Entry {
+        std::filesystem::path canonical_path;
+        std::shared_future<SourcePtr> source;
+        size_t memory_size = 0;
+        u64 last_used = 0;
+    };
 
-struct AssimpModel {
-    std::shared_ptr<AssimpModelSource> source;
+    std::mutex mutex;
+    std::unordered_map<u64, Entry> entries;
+    size_t memory_budget = size_t{512} << 20;
+    size_t memory_used = 0;
+    u64 use_counter = 0;
 
-    AssimpModel(const std::filesystem::path &path) {
-        auto find_iter = std::find_if(model_sources.begin(), model_sources.end(), [&](const std::shared_ptr<AssimpModelSource> &src) -> bool {
-            return src->path == path;
-        });
+    std::shared_future<SourcePtr> request(const std::filesystem::path &path) {
+        std::error_code ec;
+        auto canonical_path = std::filesystem::weakly_canonical(path, ec);
+        if (ec)
+            canonical_path = path;
+        auto key = fnv1a_hash(canonical_path.generic_string());
 
-        if (find_iter == model_sources.end()) {
-            source = model_sources.emplace_back(std::make_shared<AssimpModelSource>(path));
-        } else {
-            source = *find_iter;
+        std::lock_guard lock{mutex};
+        auto [iter, inserted] = entries.try_emplace(key);
+        auto &entry = iter->second;
+        if (!inserted) {
+            if (entry.canonical_path == canonical_path) {
+                entry.last_used = ++use_counter;
+                return entry.source;
+            }
+            // 64-bit hash collision: load without caching rather than
+            // handing back the wrong model.
+            return std::async(std::launch::async, [path]() { return std::make_shared<AssimpModelSource>(path); }).share();
+        }
+        entry.canonical_path = canonical_path;
+        entry.last_used = ++use_counter;
+        entry.source = std::async(std::launch::async, [this, key, path]() {
+                           auto source = std::make_shared<AssimpModelSource>(path);
+                           std::lock_guard loaded_lock{mutex};
+                           auto &loaded_entry = entries.at(key);
+                           loaded_entry.memory_size = source->memory_size();
+                           memory_used += loaded_entry.memory_size;
+                           evict_unused(key);
+                           return source;
+                       }).share();
+        return entry.source;
+    }
+
+    SourcePtr get(const std::filesystem::path &path) {
+        return request(path).get();
+    }
+
+    void trim() {
+        std::lock_guard lock{mutex};
+        evict_unused(0);
+    }
+
+  private:
+    // Called with `mutex` held. `keep_key` is the entry currently being
+    // loaded, whose future is not ready yet.
+    void evict_unused(u64 keep_key) {
+        while (memory_used > memory_budget) {
+            auto victim = entries.end();
+            for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+                auto &entry = iter->second;
+                if (iter->first == keep_key || entry.source.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    continue;
+                if (entry.source.get().use_count() > 1)
+                    continue;
+                if (victim == entries.end() || entry.last_used < victim->second.last_used)
+                    victim = iter;
+            }
+            if (victim == entries.end())
+                break;
+            memory_used -= victim->second.memory_size;
+            entries.erase(victim);
         }
     }
 };
 
-void AssimpModelSource::process_node(aiNode *node, const aiScene *scene, const std::filesystem::path &root_dir) {
-    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        nodes.push_back({});
-        auto &mesh_node = nodes.back();
-        mesh_node.modl_mat = *reinterpret_cast<f32mat4 *>(&node->mTransformation);
-        // mesh_node.norm_mat = inverse(mesh_node.modl_mat);
-        mesh_node.modl_mat = transpose(mesh_node.modl_mat);
-        for (unsigned int j = 0; j < mesh->mNumVertices; j++) {
-            Vertex vertex;
-            vertex.pos = *reinterpret_cast<f32vec3 *>(mesh->mVertices + j);
-            vertex.nrm = *reinterpret_cast<f32vec3 *>(mesh->mNormals + j);
-            vertex.tex = *reinterpret_cast<f32vec2 *>(mesh->mTextureCoords[0] + j);
-            mesh_node.vertices.push_back(vertex);
+inline ModelSourceCache model_source_cache;
+
+struct AssimpModel {
+    std::shared_ptr<AssimpModelSource> source;
+
+    AssimpModel(const std::filesystem::path &path) : source(model_source_cache.get(path)) {}
+};
+
+// Flattens the node tree into `scene_graph` and one task per (node, mesh)
+// pair, both in depth-first pre-order.
+inline std::vector<AssimpModelSource::MeshTask> AssimpModelSource::collect_mesh_tasks(const aiScene *scene, SceneGraph &scene_graph) {
+    std::vector<MeshTask> tasks;
+    std::vector<std::pair<const aiNode *, u32>> node_stack = {{scene->mRootNode, SceneGraph::NO_PARENT}};
+    while (!node_stack.empty()) {
+        auto [node, parent] = node_stack.back();
+        node_stack.pop_back();
+        auto local_mat = *reinterpret_cast<const f32mat4 *>(&node->mTransformation);
+        u32 scene_node = scene_graph.add_node(parent, transpose(local_mat));
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            tasks.push_back({.node = node, .mesh = scene->mMeshes[node->mMeshes[i]], .scene_node = scene_node});
+        for (unsigned int i = node->mNumChildren; i > 0; i--)
+            node_stack.push_back({node->mChildren[i - 1], scene_node});
+    }
+    scene_graph.update();
+    return tasks;
+}
+
+inline void AssimpModelSource::extract_mesh(const MeshTask &task, Vertex *vertex_dst, Index *index_dst) {
+    const aiMesh *mesh = task.mesh;
+    // Missing attributes read from a single default element with a zero
+    // stride, so the interleave loop below stays branch-free.
+    static const aiVector3D zero_attrib = aiVector3D{0.0f, 0.0f, 0.0f};
+    const aiVector3D *nrm_src = mesh->mNormals ? mesh->mNormals : &zero_attrib;
+    const aiVector3D *tex_src = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0] : &zero_attrib;
+    const size_t nrm_stride = mesh->mNormals ? 1 : 0;
+    const size_t tex_stride = mesh->mTextureCoords[0] ? 1 : 0;
+    const aiVector3D *pos_src = mesh->mVertices;
+    for (size_t j = 0; j < task.vertex_n; j++) {
+        const aiVector3D &p = pos_src[j];
+        const aiVector3D &n = nrm_src[j * nrm_stride];
+        const aiVector3D &t = tex_src[j * tex_stride];
+        vertex_dst[j] = Vertex{
+            .pos = {p.x, p.y, p.z},
+            .nrm = {n.x, n.y, n.z},
+            .tex = {t.x, t.y},
+        };
+    }
+    for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
+        const aiFace &face = mesh->mFaces[j];
+        std::copy_n(face.mIndices, face.mNumIndices, index_dst);
+        index_dst += face.mNumIndices;
+    }
+}
+
+inline void AssimpModelSource::process_scene(const aiScene *scene, const std::filesystem::path &root_dir) {
+    scene_graph = {};
+    nodes.clear();
+    auto tasks = collect_mesh_tasks(scene, scene_graph);
+
+    parallel_for(tasks.size(), [&](size_t i) {
+        auto &task = tasks[i];
+        task.vertex_n = task.mesh->mNumVertices;
+        task.index_n = 0;
+        for (unsigned int j = 0; j < task.mesh->mNumFaces; j++)
+            task.index_n += task.mesh->mFaces[j].mNumIndices;
+    });
+    size_t vertex_n = 0, index_n = 0;
+    for (auto &task : tasks) {
+        task.vertex_offset = vertex_n;
+        task.index_offset = index_n;
+        vertex_n += task.vertex_n;
+        index_n += task.index_n;
+    }
+
+    vertex_storage.resize(vertex_n);
+    index_storage.resize(index_n);
+    parallel_for(tasks.size(), [&](size_t i) {
+        extract_mesh(tasks[i], vertex_storage.data() + tasks[i].vertex_offset, index_storage.data() + tasks[i].index_offset);
+    });
+
+    std::vector<mesh_optimize::OptimizeResult> optimize_results(tasks.size());
+    parallel_for(tasks.size(), [&](size_t i) {
+        auto &task = tasks[i];
+        // Only pure triangle lists are reordered. Meshes that still carry
+        // point or line primitives after triangulation are left as-is.
+        if (task.index_n != size_t{task.mesh->mNumFaces} * 3)
+            return;
+        optimize_results[i] = mesh_optimize::optimize_mesh(
+            std::span<Vertex>(vertex_storage).subspan(task.vertex_offset, task.vertex_n),
+            std::span<Index>(index_storage).subspan(task.index_offset, task.index_n));
+        task.vertex_n = optimize_results[i].vertex_n;
+    });
+    // Welding shrinks the per-mesh vertex ranges, so close the gaps.
+    size_t compacted_n = 0;
+    for (auto &task : tasks) {
+        auto first = vertex_storage.begin() + static_cast<std::ptrdiff_t>(task.vertex_offset);
+        std::copy(first, first + static_cast<std::ptrdiff_t>(task.vertex_n), vertex_storage.begin() + static_cast<std::ptrdiff_t>(compacted_n));
+        task.vertex_offset = compacted_n;
+        compacted_n += task.vertex_n;
+    }
+    vertex_storage.resize(compacted_n);
+
+    // LODs are simplified from the previous level, so their errors add up.
+    // Each level's indices are appended after all the full-detail ones.
+    struct GeneratedLod {
+        std::vector<Index> indices;
+        f32 error;
+    };
+    std::vector<std::vector<GeneratedLod>> task_lods(tasks.size());
+    parallel_for(tasks.size(), [&](size_t i) {
+        const auto &task = tasks[i];
+        if (task.index_n != size_t{task.mesh->mNumFaces} * 3)
+            return;
+        auto task_vertices = std::span<const Vertex>(vertex_storage).subspan(task.vertex_offset, task.vertex_n);
+        auto get_pos = [&](size_t v) { return task_vertices[v].pos; };
+        auto prev = std::span<const Index>(index_storage).subspan(task.index_offset, task.index_n);
+        f32 prev_error = 0.0f;
+        for (size_t level = 1; level < MAX_LOD_N; ++level) {
+            size_t target_index_n = prev.size() / 6 * 3;
+            f32 error = 0.0f;
+            auto simplified = mesh_simplify::simplify(prev, task.vertex_n, get_pos, target_index_n, std::numeric_limits<f32>::max(), &error);
+            // stop once the mesh barely shrinks (mostly locked borders)
+            if (simplified.empty() || simplified.size() * 5 > prev.size() * 4)
+                break;
+            auto &lod = task_lods[i].emplace_back(GeneratedLod{
+                .indices = mesh_optimize::optimize_vertex_cache(simplified, task.vertex_n),
+                .error = prev_error + error,
+            });
+            prev = lod.indices;
+            prev_error = lod.error;
         }
-        for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
-            aiFace face = mesh->mFaces[j];
-            for (unsigned int k = 0; k < face.mNumIndices; k++)
-                mesh_node.indices.push_back(face.mIndices[k]);
+    });
+    std::array<size_t, MAX_LOD_N> lod_triangle_n{};
+    lod_triangle_n[0] = index_storage.size() / 3;
+    std::vector<std::array<size_t, MAX_LOD_N>> lod_offsets(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        for (size_t level = 0; level < task_lods[i].size(); ++level) {
+            lod_offsets[i][level] = index_storage.size();
+            index_storage.insert(index_storage.end(), task_lods[i][level].indices.begin(), task_lods[i][level].indices.end());
+            lod_triangle_n[level + 1] += task_lods[i][level].indices.size() / 3;
         }
-        auto get_texture_paths = [&root_dir](auto material, auto type) {
-            std::vector<std::filesystem::path> paths;
-            auto n = material->GetTextureCount(type);
-            paths.reserve(n);
-            for (size_t i = 0; i < n; ++i) {
-                aiString relpath;
-                material->GetTexture(type, static_cast<u32>(i), &relpath);
-                paths.push_back(root_dir / std::filesystem::path(relpath.C_Str()));
+    }
+
+    mesh_optimize::CacheStats stats_before, stats_after;
+    for (const auto &result : optimize_results) {
+        stats_before += result.before;
+        stats_after += result.after;
+    }
+    std::cout << path.filename().string() << ": " << vertex_n << " -> " << compacted_n << " vertices, "
+              << "ACMR " << stats_before.acmr() << " -> " << stats_after.acmr() << ", "
+              << "ATVR " << stats_before.atvr() << " -> " << stats_after.atvr() << ", "
+              << "LOD triangles";
+    for (size_t level = 0; level < MAX_LOD_N; ++level)
+        std::cout << (level ? " / " : " ") << lod_triangle_n[level];
+    std::cout << "\n";
+    vertices = vertex_storage;
+    indices = index_storage;
+
+    nodes.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        const auto &task = tasks[i];
+        // auto norm_mat = inverse(modl_mat);
+        auto &node = nodes.emplace_back(Node{
+            .indices = indices.subspan(task.index_offset, task.index_n),
+            .vertices = vertices.subspan(task.vertex_offset, task.vertex_n),
+            .modl_mat = scene_graph.world_mats[task.scene_node],
+            .scene_node = task.scene_node,
+            .material = task.mesh->mMaterialIndex,
+            .bounds_min = {0.0f, 0.0f, 0.0f},
+            .bounds_max = {0.0f, 0.0f, 0.0f},
+            .lods = {},
+            .lod_n = static_cast<u32>(1 + task_lods[i].size()),
+        });
+        node.lods[0] = {.indices = node.indices, .error = 0.0f};
+        for (size_t level = 0; level < task_lods[i].size(); ++level)
+            node.lods[level + 1] = {.indices = indices.subspan(lod_offsets[i][level], task_lods[i][level].indices.size()), .error = task_lods[i][level].error};
+        if (!node.vertices.empty()) {
+            node.bounds_min = node.vertices[0].pos, node.bounds_max = node.vertices[0].pos;
+            for (const auto &v : node.vertices) {
+                for (size_t k = 0; k < 3; ++k) {
+                    node.bounds_min[k] = std::min(node.bounds_min[k], v.pos[k]);
+                    node.bounds_max[k] = std::max(node.bounds_max[k], v.pos[k]);
+                }
             }
-            return paths;
-        };
-        aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-        albedo_texture_paths = get_texture_paths(material, aiTextureType_DIFFUSE);
-        normal_texture_paths = get_texture_paths(material, aiTextureType_NORMALS);
+        }
+    }
+
+    auto get_texture_paths = [&root_dir](auto material, auto type) {
+        std::vector<std::filesystem::path> paths;
+        auto n = material->GetTextureCount(type);
+        paths.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            aiString relpath;
+            material->GetTexture(type, static_cast<u32>(i), &relpath);
+            paths.push_back(root_dir / std::filesystem::path(relpath.C_Str()));
+        }
+        return paths;
+    };
+    materials.clear();
+    materials.reserve(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i) {
+        const aiMaterial *material = scene->mMaterials[i];
+        materials.push_back({
+            .albedo_texture_paths = get_texture_paths(material, aiTextureType_DIFFUSE),
+            .normal_texture_paths = get_texture_paths(material, aiTextureType_NORMALS),
+        });
     }
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
-        process_node(node->mChildren[i], scene, root_dir);
 }
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include "scene_graph.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr u64 fnv1a_hash(std::span<const u8> bytes, u64 hash = 0xcbf29ce484222325) {
+    for (auto b : bytes) {
+        hash ^= b;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+inline u64 fnv1a_hash(std::string_view str, u64 hash = 0xcbf29ce484222325) {
+    return fnv1a_hash(std::span<const u8>(reinterpret_cast<const u8 *>(str.data()), str.size()), hash);
+}
+
+// Read-only view of a whole file, backed by mmap/MapViewOfFile. The mapping
+// stays valid for the lifetime of the object, so callers may hand out spans
+// into it instead of copying.
+struct MappedFile {
+    const u8 *data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = nullptr;
+#endif
+
+    MappedFile() = default;
+    MappedFile(const std::filesystem::path &path) {
+#if defined(_WIN32)
+        file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+            return;
+        mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_handle)
+            return;
+        data = reinterpret_cast<const u8 *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (data)
+            size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = reinterpret_cast<const u8 *>(ptr);
+                size = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) {
+        *this = std::move(other);
+    }
+    MappedFile &operator=(MappedFile &&other) {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+#if defined(_WIN32)
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+#endif
+        return *this;
+    }
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_handle)
+            CloseHandle(mapping_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+#else
+        if (data)
+            munmap(const_cast<u8 *>(data), size);
+#endif
+    }
+
+    bool is_valid() const {
+        return data != nullptr;
+    }
+};
+
+// On-disk layout of a cached model. Everything after the header is
+// addressed by byte offsets from the start of the file, and the vertex and
+// index blobs are 16-byte aligned so they can be used straight out of the
+// mapping.
+//
+//   ModelCacheHeader
+//   ModelCacheNode[node_n]
+//   ModelCacheSceneNode[scene_node_n]
+//   Vertex[vertex_n]            @ vertex_offset
+//   Index[index_n]              @ index_offset
+//   per material @ materials_offset:
+//     u32 albedo_path_n, normal_path_n
+//     { u32 len; char str[len]; }, albedo paths then normal paths
+struct ModelCacheHeader {
+    static constexpr u32 MAGIC = 0x4c444d43; // "CMDL"
+    static constexpr u32 VERSION = 6;
+
+    u32 magic;
+    u32 version;
+    u32 vertex_size;
+    u32 index_size;
+    u64 path_hash;
+    i64 source_mtime;
+    u64 source_size;
+    u64 source_hash;
+    u64 node_n;
+    u64 scene_node_n;
+    u64 vertex_n, vertex_offset;
+    u64 index_n, index_offset;
+    u64 material_n, materials_offset;
+};
+
+struct ModelCacheLod {
+    u64 index_offset, index_n;
+    f32 error;
+    u32 padding;
+};
+
+struct ModelCacheNode {
+    static constexpr size_t MAX_LOD_N = 4;
+
+    u32 scene_node;
+    u32 lod_n;
+    u32 material;
+    u32 padding;
+    u64 vertex_offset, vertex_n;
+    // lods[0] is the full-detail mesh
+    ModelCacheLod lods[MAX_LOD_N];
+    f32vec3 bounds_min, bounds_max;
+};
+
+// Scene graph nodes in depth-first pre-order; world matrices are rebuilt
+// on load.
+struct ModelCacheSceneNode {
+    f32mat4 local_mat;
+    u32 parent;
+};
+
+struct ModelCache {
+    static inline std::filesystem::path cache_dir = std::filesystem::temp_directory_path() / "coel_samples_model_cache";
+
+    static u64 hash_file(const std::filesystem::path &path) {
+        auto file = MappedFile(path);
+        if (!file.is_valid())
+            return 0;
+        return fnv1a_hash(std::span<const u8>(file.data, file.size));
+    }
+
+    static i64 file_mtime(const std::filesystem::path &path) {
+        std::error_code ec;
+        auto t = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : static_cast<i64>(t.time_since_epoch().count());
+    }
+
+    static std::filesystem::path cache_path(const std::filesystem::path &path, u64 path_hash) {
+        auto name = path.stem().string() + "_";
+        for (i32 shift = 60; shift >= 0; shift -= 4)
+            name += "0123456789abcdef"[(path_hash >> shift) & 0xf];
+        return cache_dir / (name + ".bin");
+    }
+
+    static u64 canonical_path_hash(const std::filesystem::path &path) {
+        std::error_code ec;
+        auto canonical = std::filesystem::weakly_canonical(path, ec);
+        return fnv1a_hash((ec ? path : canonical).generic_string());
+    }
+
+    // Fills `source` with spans into a mapping of its cache file. Returns
+    // false if there is no cache entry or it is stale, in which case the
+    // caller should import the model and call `store`.
+    static bool load(auto &source) {
+        using Source = std::remove_cvref_t<decltype(source)>;
+        using Vertex = typename Source::Vertex;
+        using Index = typename Source::Index;
+
+        auto path_hash = canonical_path_hash(source.path);
+        auto file = MappedFile(cache_path(source.path, path_hash));
+        if (!file.is_valid() || file.size < sizeof(ModelCacheHeader))
+            return false;
+
+        const auto &header = *reinterpret_cast<const ModelCacheHeader *>(file.data);
+        if (header.magic != ModelCacheHeader::MAGIC || header.version != ModelCacheHeader::VERSION ||
+            header.vertex_size != sizeof(Vertex) || header.index_size != sizeof(Index) ||
+            header.path_hash != path_hash)
+            return false;
+
+        std::error_code ec;
+        auto source_size = std::filesystem::file_size(source.path, ec);
+        if (ec || header.source_size != source_size)
+            return false;
+        // A matching mtime is trusted as-is. Otherwise (e.g. after a fresh
+        // checkout) fall back to comparing the content hash.
+        if (header.source_mtime != file_mtime(source.path) && header.source_hash != hash_file(source.path))
+            return false;
+
+        if (header.vertex_offset + header.vertex_n * sizeof(Vertex) > file.size ||
+            header.index_offset + header.index_n * sizeof(Index) > file.size ||
+            sizeof(ModelCacheHeader) + header.node_n * sizeof(ModelCacheNode) + header.scene_node_n * sizeof(ModelCacheSceneNode) > file.size ||
+            header.materials_offset > file.size)
+            return false;
+
+        auto vertices = std::span<const Vertex>(reinterpret_cast<const Vertex *>(file.data + header.vertex_offset), header.vertex_n);
+        auto indices = std::span<const Index>(reinterpret_cast<const Index *>(file.data + header.index_offset), header.index_n);
+        auto cache_nodes = std::span<const ModelCacheNode>(reinterpret_cast<const ModelCacheNode *>(file.data + sizeof(ModelCacheHeader)), header.node_n);
+        auto scene_nodes_ptr = file.data + sizeof(ModelCacheHeader) + header.node_n * sizeof(ModelCacheNode);
+        auto scene_nodes = std::span<const ModelCacheSceneNode>(reinterpret_cast<const ModelCacheSceneNode *>(scene_nodes_ptr), header.scene_node_n);
+
+        // Decoded into locals and only moved into `source` once everything
+        // checks out, so a rejected cache leaves no spans into the mapping
+        // (unmapped on return) behind for the import fallback.
+        SceneGraph scene_graph;
+        decltype(source.nodes) nodes;
+        decltype(source.materials) materials;
+        for (const auto &scene_node : scene_nodes) {
+            if (scene_node.parent != SceneGraph::NO_PARENT && scene_node.parent >= scene_graph.size())
+                return false;
+            scene_graph.add_node(scene_node.parent, scene_node.local_mat);
+        }
+        scene_graph.update();
+
+        nodes.reserve(cache_nodes.size());
+        for (const auto &cache_node : cache_nodes) {
+            if (cache_node.vertex_offset + cache_node.vertex_n > vertices.size() ||
+                cache_node.scene_node >= scene_graph.size() ||
+                cache_node.material >= header.material_n ||
+                cache_node.lod_n == 0 || cache_node.lod_n > ModelCacheNode::MAX_LOD_N)
+                return false;
+            auto &node = nodes.emplace_back();
+            node.vertices = vertices.subspan(cache_node.vertex_offset, cache_node.vertex_n);
+            node.modl_mat = scene_graph.world_mats[cache_node.scene_node];
+            node.scene_node = cache_node.scene_node;
+            node.material = cache_node.material;
+            node.bounds_min = cache_node.bounds_min;
+            node.bounds_max = cache_node.bounds_max;
+            node.lod_n = cache_node.lod_n;
+            for (u32 i = 0; i < cache_node.lod_n; ++i) {
+                const auto &lod = cache_node.lods[i];
+                if (lod.index_offset + lod.index_n > indices.size())
+                    return false;
+                node.lods[i] = {.indices = indices.subspan(lod.index_offset, lod.index_n), .error = lod.error};
+            }
+            node.indices = node.lods[0].indices;
+        }
+
+        auto read_ptr = file.data + header.materials_offset;
+        auto read_u32 = [&](u32 &value) {
+            if (read_ptr + sizeof(value) > file.data + file.size)
+                return false;
+            std::memcpy(&value, read_ptr, sizeof(value));
+            read_ptr += sizeof(value);
+            return true;
+        };
+        auto read_paths = [&](auto &paths, u64 n) {
+            paths.clear();
+            for (u64 i = 0; i < n; ++i) {
+                u32 len;
+                if (!read_u32(len) || read_ptr + len > file.data + file.size)
+                    return false;
+                paths.push_back(std::string(reinterpret_cast<const char *>(read_ptr), len));
+                read_ptr += len;
+            }
+            return true;
+        };
+        for (u64 i = 0; i < header.material_n; ++i) {
+            auto &material = materials.emplace_back();
+            u32 albedo_path_n, normal_path_n;
+            if (!read_u32(albedo_path_n) || !read_u32(normal_path_n) ||
+                !read_paths(material.albedo_texture_paths, albedo_path_n) ||
+                !read_paths(material.normal_texture_paths, normal_path_n))
+                return false;
+        }
+
+        source.scene_graph = std::move(scene_graph);
+        source.nodes = std::move(nodes);
+        source.materials = std::move(materials);
+        source.vertices = vertices;
+        source.indices = indices;
+        source.vertex_storage.clear();
+        source.index_storage.clear();
+        source.cache_file = std::move(file);
+        return true;
+    }
+
+    static void store(const auto &source) {
+        using Source = std::remove_cvref_t<decltype(source)>;
+        using Vertex = typename Source::Vertex;
+        using Index = typename Source::Index;
+
+        auto align16 = [](u64 x) { return (x + 15) & ~u64{15}; };
+
+        ModelCacheHeader header{
+            .magic = ModelCacheHeader::MAGIC,
+            .version = ModelCacheHeader::VERSION,
+            .vertex_size = sizeof(Vertex),
+            .index_size = sizeof(Index),
+            .path_hash = canonical_path_hash(source.path),
+            .source_mtime = file_mtime(source.path),
+            .source_size = 0,
+            .source_hash = hash_file(source.path),
+            .node_n = source.nodes.size(),
+            .scene_node_n = source.scene_graph.size(),
+            .vertex_n = source.vertices.size(),
+            .vertex_offset = 0,
+            .index_n = source.indices.size(),
+            .index_offset = 0,
+            .material_n = source.materials.size(),
+            .materials_offset = 0,
+        };
+        std::error_code ec;
+        header.source_size = std::filesystem::file_size(source.path, ec);
+        if (ec)
+            return;
+        header.vertex_offset = align16(sizeof(ModelCacheHeader) + header.node_n * sizeof(ModelCacheNode) + header.scene_node_n * sizeof(ModelCacheSceneNode));
+        header.index_offset = align16(header.vertex_offset + header.vertex_n * sizeof(Vertex));
+        header.materials_offset = header.index_offset + header.index_n * sizeof(Index);
+
+        std::vector<ModelCacheNode> cache_nodes;
+        cache_nodes.reserve(source.nodes.size());
+        for (const auto &node : source.nodes) {
+            auto &cache_node = cache_nodes.emplace_back();
+            cache_node.scene_node = node.scene_node;
+            cache_node.lod_n = node.lod_n;
+            cache_node.material = node.material;
+            cache_node.vertex_offset = static_cast<u64>(node.vertices.data() - source.vertices.data());
+            cache_node.vertex_n = node.vertices.size();
+            for (u32 i = 0; i < node.lod_n; ++i) {
+                cache_node.lods[i] = {
+                    .index_offset = static_cast<u64>(node.lods[i].indices.data() - source.indices.data()),
+                    .index_n = node.lods[i].indices.size(),
+                    .error = node.lods[i].error,
+                    .padding = 0,
+                };
+            }
+            cache_node.bounds_min = node.bounds_min;
+            cache_node.bounds_max = node.bounds_max;
+        }
+        std::vector<ModelCacheSceneNode> scene_nodes;
+        scene_nodes.reserve(source.scene_graph.size());
+        for (size_t i = 0; i < source.scene_graph.size(); ++i)
+            scene_nodes.push_back({.local_mat = source.scene_graph.local_mats[i], .parent = source.scene_graph.parents[i]});
+
+        std::filesystem::create_directories(cache_dir, ec);
+        auto final_path = cache_path(source.path, header.path_hash);
+        auto temp_path = final_path;
+        temp_path += ".tmp";
+        {
+            auto out = std::ofstream(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return;
+            auto write = [&](const void *data, u64 size) {
+                out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+            };
+            auto pad_to = [&](u64 offset) {
+                const char zeros[16] = {};
+                auto pos = static_cast<u64>(out.tellp());
+                write(zeros, offset - pos);
+            };
+            write(&header, sizeof(header));
+            write(cache_nodes.data(), cache_nodes.size() * sizeof(ModelCacheNode));
+            write(scene_nodes.data(), scene_nodes.size() * sizeof(ModelCacheSceneNode));
+            pad_to(header.vertex_offset);
+            write(source.vertices.data(), source.vertices.size() * sizeof(Vertex));
+            pad_to(header.index_offset);
+            write(source.indices.data(), source.indices.size() * sizeof(Index));
+            auto write_paths = [&](const auto &paths) {
+                for (const auto &p : paths) {
+                    auto str = p.string();
+                    auto len = static_cast<u32>(str.size());
+                    write(&len, sizeof(len));
+                    write(str.data(), len);
+                }
+            };
+            for (const auto &material : source.materials) {
+                auto albedo_path_n = static_cast<u32>(material.albedo_texture_paths.size());
+                auto normal_path_n = static_cast<u32>(material.normal_texture_paths.size());
+                write(&albedo_path_n, sizeof(albedo_path_n));
+                write(&normal_path_n, sizeof(normal_path_n));
+                write_paths(material.albedo_texture_paths);
+                write_paths(material.normal_texture_paths);
+            }
+            if (!out)
+                return;
+        }
+        // Write-then-rename so a concurrent or interrupted run never maps a
+        // half-written cache file.
+        std::filesystem::rename(temp_path, final_path, ec);
+        if (ec)
+            std::filesystem::remove(temp_path, ec);
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Runs fn(i) for every i in [0, n) on all hardware threads, including the
+// calling one. Work is handed out in chunks from a shared counter so items
+// of uneven cost still balance across threads.
+inline void parallel_for(size_t n, auto &&fn, size_t chunk_size = 1) {
+    size_t chunk_n = (n + chunk_size - 1) / chunk_size;
+    size_t thread_n = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunk_n);
+    if (thread_n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+    std::atomic<size_t> next_i = 0;
+    auto worker = [&]() {
+        while (true) {
+            size_t begin = next_i.fetch_add(chunk_size, std::memory_order_relaxed);
+            if (begin >= n)
+                break;
+            size_t end = std::min(begin + chunk_size, n);
+            for (size_t i = begin; i < end; ++i)
+                fn(i);
+        }
+    };
+    std::vector<std::jthread> threads;
+    threads.reserve(thread_n - 1);
+    for (size_t i = 0; i < thread_n - 1; ++i)
+        threads.emplace_back(worker);
+    worker();
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+// One timed scope. `name` must outlive the profiler (a string literal).
+struct ProfileEvent {
+    const char *name;
+    u64 begin_ns, end_ns;
+    // frame the scope started in
+    u64 frame;
+    u32 depth;
+};
+
+// Event ring of one recording thread (or the GPU). Only the owner writes,
+// publishing each event with a release store of `write_n`, so recording
+// never takes a lock. Readers copy a range and then re-check `write_n` to
+// drop anything the writer may have lapped meanwhile.
+struct ProfileTrack {
+    static constexpr size_t CAPACITY = size_t{1} << 14;
+
+    std::string name;
+    u32 id;
+    std::unique_ptr<ProfileEvent[]> events = std::make_unique<ProfileEvent[]>(CAPACITY);
+    std::atomic<u64> write_n = 0;
+    // owned by a live thread; free tracks are handed to new threads
+    std::atomic<bool> in_use = true;
+    u32 depth = 0;
+
+    void push(const ProfileEvent &event) {
+        auto n = write_n.load(std::memory_order_relaxed);
+        events[n % CAPACITY] = event;
+        write_n.store(n + 1, std::memory_order_release);
+    }
+
+    // Appends the retained events for which pred(event) holds.
+    void copy_events(std::vector<ProfileEvent> &out, auto &&pred) const {
+        auto end = write_n.load(std::memory_order_acquire);
+        auto begin = end > CAPACITY ? end - CAPACITY : 0;
+        std::vector<ProfileEvent> copied(end - begin);
+        for (auto i = begin; i < end; ++i)
+            copied[i - begin] = events[i % CAPACITY];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto now_n = write_n.load(std::memory_order_relaxed);
+        auto valid_begin = std::max(begin, now_n > CAPACITY ? now_n - CAPACITY : 0);
+        for (auto i = valid_begin; i < end; ++i) {
+            if (pred(copied[i - begin]))
+                out.push_back(copied[i - begin]);
+        }
+    }
+};
+
+// Per-frame aggregate of one scope name on one track.
+struct ProfileSummary {
+    const char *name;
+    u32 track_id;
+    u32 depth;
+    u32 count;
+    f64 total_ms;
+};
+
+// CPU scope profiler. Threads get a track the first time they record;
+// tracks of threads that have exited are reused, so the short-lived
+// workers of `parallel_for` don't pile up. The GPU track is filled by
+// GpuTimer with timestamps converted to the same clock.
+//
+//     void update() {
+//         PROFILE_SCOPE("update");
+//         ...
+//     }
+struct Profiler {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point epoch = clock::now();
+    std::atomic<bool> enabled = true;
+    // frames completed so far; events started now are tagged with this
+    std::atomic<u64> frame = 0;
+    u64 frame_begin_ns = 0;
+    u64 last_frame_begin_ns = 0, last_frame_end_ns = 0;
+
+    u64 now_ns() const {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch).count());
+    }
+
+    ProfileTrack &this_thread() {
+        struct Owner {
+            ProfileTrack *track = nullptr;
+            ~Owner() {
+                if (track)
+                    track->in_use.store(false, std::memory_order_release);
+            }
+        };
+        thread_local Owner owner;
+        if (!owner.track)
+            owner.track = &acquire_track("thread");
+        return *owner.track;
+    }
+
+    void set_thread_name(std::string name) {
+        auto &track = this_thread();
+        auto lock = std::lock_guard(tracks_mutex);
+        track.name = std::move(name);
+    }
+
+    // Written by GpuTimer on the context thread only.
+    ProfileTrack &gpu_track() {
+        if (!gpu) {
+            auto &track = acquire_track("GPU");
+            auto lock = std::lock_guard(tracks_mutex);
+            track.name = "GPU";
+            gpu = &track;
+        }
+        return *gpu;
+    }
+
+    // Call once per frame, on the thread that drives frames.
+    void end_frame() {
+        auto now = now_ns();
+        last_frame_begin_ns = frame_begin_ns;
+        last_frame_end_ns = now;
+        frame_begin_ns = now;
+        frame.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Events of every track matching pred(track, event).
+    std::vector<ProfileEvent> collect(auto &&pred) {
+        std::vector<ProfileEvent> result;
+        auto lock = std::lock_guard(tracks_mutex);
+        for (const auto &track : tracks)
+            track->copy_events(result, [&](const ProfileEvent &e) { return pred(*track, e); });
+        return result;
+    }
+
+    // Totals per (track, scope) for the last completed frame, or for GPU
+    // scopes the newest frame with results, in track order.
+    std::vector<ProfileSummary> summarize(u64 gpu_frame) {
+        std::vector<ProfileSummary> result;
+        auto cpu_frame = frame.load(std::memory_order_relaxed);
+        if (cpu_frame == 0)
+            return result;
+        auto lock = std::lock_guard(tracks_mutex);
+        std::vector<ProfileEvent> events;
+        for (const auto &track : tracks) {
+            auto wanted = track.get() == gpu ? gpu_frame : cpu_frame - 1;
+            events.clear();
+            track->copy_events(events, [&](const ProfileEvent &e) { return e.frame == wanted; });
+            auto first = result.size();
+            for (const auto &e : events) {
+                auto it = std::find_if(result.begin() + static_cast<std::ptrdiff_t>(first), result.end(), [&](const auto &s) { return s.name == e.name; });
+                if (it == result.end()) {
+                    result.push_back({e.name, track->id, e.depth, 0, 0.0});
+                    it = result.end() - 1;
+                }
+                it->depth = std::min(it->depth, e.depth);
+                ++it->count;
+                it->total_ms += static_cast<f64>(e.end_ns - e.begin_ns) * 1e-6;
+            }
+        }
+        return result;
+    }
+
+    std::string track_name(u32 id) {
+        auto lock = std::lock_guard(tracks_mutex);
+        return id < tracks.size() ? tracks[id]->name : std::string();
+    }
+
+    // Writes everything still held by the tracks in the Chrome trace event
+    // format (chrome://tracing, ui.perfetto.dev).
+    bool write_chrome_trace(const std::filesystem::path &path) {
+        auto out = std::ofstream(path, std::ios::trunc);
+        if (!out)
+            return false;
+        auto write_string = [&](std::string_view str) {
+            out << '"';
+            for (auto c : str) {
+                if (c == '"' || c == '\\')
+                    out << '\\';
+                out << c;
+            }
+            out << '"';
+        };
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto lock = std::lock_guard(tracks_mutex);
+        std::vector<ProfileEvent> events;
+        for (const auto &track : tracks) {
+            out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << track->id << ",\"args\":{\"name\":";
+            write_string(track->name);
+            out << "}}";
+            first = false;
+            events.clear();
+            track->copy_events(events, [](const ProfileEvent &) { return true; });
+            for (const auto &e : events) {
+                out << ",\n{\"ph\":\"X\",\"name\":";
+                write_string(e.name);
+                out << ",\"pid\":1,\"tid\":" << track->id << ",\"ts\":" << static_cast<f64>(e.begin_ns) * 1e-3
+                    << ",\"dur\":" << static_cast<f64>(e.end_ns - e.begin_ns) * 1e-3 << ",\"args\":{\"frame\":" << e.frame << "}}";
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+  private:
+    std::mutex tracks_mutex;
+    std::vector<std::unique_ptr<ProfileTrack>> tracks;
+    ProfileTrack *gpu = nullptr;
+
+    ProfileTrack &acquire_track(const char *name) {
+        auto lock = std::lock_guard(tracks_mutex);
+        for (auto &track : tracks) {
+            bool expected = false;
+            if (track->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                track->name = std::string(name) + " " + std::to_string(track->id);
+                track->depth = 0;
+                return *track;
+            }
+        }
+        auto &track = tracks.emplace_back(std::make_unique<ProfileTrack>());
+        track->id = static_cast<u32>(tracks.size() - 1);
+        track->name = std::string(name) + " " + std::to_string(track->id);
+        return *track;
+    }
+};
+
+inline Profiler &profiler() {
+    static Profiler instance;
+    return instance;
+}
+
+struct ProfileScope {
+    const char *name;
+    ProfileTrack *track = nullptr;
+    u64 begin_ns, frame;
+
+    ProfileScope(const char *name_) : name(name_) {
+        auto &p = profiler();
+        if (!p.enabled.load(std::memory_order_relaxed))
+            return;
+        track = &p.this_thread();
+        ++track->depth;
+        frame = p.frame.load(std::memory_order_relaxed);
+        begin_ns = p.now_ns();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    ~ProfileScope() {
+        if (!track)
+            return;
+        --track->depth;
+        track->push({name, begin_ns, profiler().now_ns(), frame, track->depth});
+    }
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+struct PackRect {
+    u32 x, y, w, h;
+};
+
+// Skyline bottom-left rectangle packer. The free space is tracked as the
+// top edge of everything placed so far; a rectangle goes wherever that
+// leaves its top edge lowest, ties broken by the least area wasted under
+// it. Cheap, good for many small rectangles, and supports incremental
+// insertion. Space is never reclaimed, so removal is done by repacking.
+struct SkylinePacker {
+    struct Segment {
+        u32 x, y, w;
+    };
+
+    u32 size_x = 0, size_y = 0;
+    std::vector<Segment> skyline;
+    u64 used_area = 0;
+
+    SkylinePacker() = default;
+    SkylinePacker(u32 size_x_, u32 size_y_) : size_x(size_x_), size_y(size_y_) {
+        clear();
+    }
+
+    void clear() {
+        skyline.assign(1, {0, 0, size_x});
+        used_area = 0;
+    }
+
+    std::optional<PackRect> insert(u32 w, u32 h) {
+        if (w == 0 || h == 0 || w > size_x || h > size_y)
+            return std::nullopt;
+        size_t best_i = skyline.size();
+        u32 best_top = std::numeric_limits<u32>::max(), best_waste = std::numeric_limits<u32>::max(), best_y = 0;
+        for (size_t i = 0; i < skyline.size(); ++i) {
+            u32 y = 0, waste = 0;
+            if (!fit(i, w, h, y, waste))
+                continue;
+            if (y + h < best_top || (y + h == best_top && waste < best_waste)) {
+                best_i = i, best_top = y + h, best_waste = waste, best_y = y;
+            }
+        }
+        if (best_i == skyline.size())
+            return std::nullopt;
+        PackRect result{skyline[best_i].x, best_y, w, h};
+        place(best_i, result);
+        used_area += u64{w} * h;
+        return result;
+    }
+
+    // Fraction of the bin covered by placed rectangles.
+    f32 occupancy() const {
+        return size_x && size_y ? static_cast<f32>(static_cast<f64>(used_area) / (static_cast<f64>(size_x) * size_y)) : 0.0f;
+    }
+
+  private:
+    // Can a w x h rectangle sit with its left edge on segment `i`? If so,
+    // `y` is the height it rests at and `waste` the area left under it.
+    bool fit(size_t i, u32 w, u32 h, u32 &y, u32 &waste) const {
+        u32 x = skyline[i].x;
+        if (x + w > size_x)
+            return false;
+        y = skyline[i].y;
+        for (size_t j = i; j < skyline.size() && skyline[j].x < x + w; ++j)
+            y = std::max(y, skyline[j].y);
+        if (y + h > size_y)
+            return false;
+        waste = 0;
+        for (size_t j = i; j < skyline.size() && skyline[j].x < x + w; ++j) {
+            u32 covered = std::min(skyline[j].x + skyline[j].w, x + w) - skyline[j].x;
+            waste += covered * (y - skyline[j].y);
+        }
+        return true;
+    }
+
+    void place(size_t i, const PackRect &rect) {
+        skyline.insert(skyline.begin() + static_cast<std::ptrdiff_t>(i), {rect.x, rect.y + rect.h, rect.w});
+        // trim or drop the segments now under the new one
+        u32 right = rect.x + rect.w;
+        for (size_t j = i + 1; j < skyline.size();) {
+            auto &seg = skyline[j];
+            if (seg.x >= right)
+                break;
+            u32 seg_right = seg.x + seg.w;
+            if (seg_right <= right) {
+                skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(j));
+                continue;
+            }
+            seg.w = seg_right - right;
+            seg.x = right;
+            break;
+        }
+        // merge neighbours at the same height
+        for (size_t j = 0; j + 1 < skyline.size();) {
+            if (skyline[j].y == skyline[j + 1].y) {
+                skyline[j].w += skyline[j + 1].w;
+                skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(j + 1));
+            } else {
+                ++j;
+            }
+        }
+    }
+};
@@ -1,8 +1,22 @@
 #pragma once
 
+#include "command_list.hpp"
+#include "culling.hpp"
+#include "gl_state.hpp"
+#include "gpu_timer.hpp"
+#include "instancing.hpp"
 #include "model.hpp"
+#include "scene_clock.hpp"
+#include "shader_cache.hpp"
+#include "texture_atlas.hpp"
+#include "texture_stream.hpp"
+#include "uniform_buffer.hpp"
+#include "vertex_format.hpp"
 
 #include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 
 #include <glad/glad.h>
@@ -11,15 +25,16 @@
 struct RenderPass {
     u32vec2 size;
     void begin() {
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LEQUAL);
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glViewport(0, 0, size.x, size.y);
-        glClearColor(0.6f, 0.7f, 1.0f, 1.0f);
-        // glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClearDepth(1.0f);
+        auto &state = gl_state();
+        state.enable(GL_DEPTH_TEST);
+        state.depth_func(GL_LEQUAL);
+        state.enable(GL_CULL_FACE);
+        state.enable(GL_BLEND);
+        state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.viewport(0, 0, static_cast<i32>(size.x), static_cast<i32>(size.y));
+        state.clear_color(0.6f, 0.7f, 1.0f, 1.0f);
+        // state.clear_color(0.0f, 0.0f, 0.0f, 1.0f);
+        state.clear_depth(1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 };
@@ -42,110 +57,321 @@ struct Uniform {
     }
 };
 
+struct ShaderStats {
+    // loaded from the binary cache rather than compiled
+    bool from_cache = false;
+    bool linked = false;
+    // constructor, and constructor until linked
+    f64 submit_ms = 0.0;
+    f64 ready_ms = 0.0;
+};
+
+// Startup cost of every Shader, reported as one line once all the programs
+// submitted so far have linked rather than a line per program. Programs
+// created later (a new scene) get a line of their own the same way.
+struct ShaderSummary {
+    using clock = std::chrono::steady_clock;
+
+    u32 pending_n = 0;
+    u32 warm_n = 0, cold_n = 0, failed_n = 0;
+    // summed over programs
+    f64 submit_ms = 0.0;
+    clock::time_point first_submit, last_ready;
+
+    void submitted(clock::time_point start) {
+        if (pending_n == 0 && warm_n + cold_n + failed_n == 0)
+            first_submit = start;
+        ++pending_n;
+    }
+
+    void finished(const ShaderStats &stats) {
+        --pending_n;
+        if (!stats.linked)
+            ++failed_n;
+        else if (stats.from_cache)
+            ++warm_n;
+        else
+            ++cold_n;
+        submit_ms += stats.submit_ms;
+        last_ready = clock::now();
+    }
+
+    // For a program destroyed before it finished.
+    void abandoned() {
+        --pending_n;
+    }
+
+    void report() {
+        if (pending_n != 0 || warm_n + cold_n + failed_n == 0)
+            return;
+        auto ready_ms = std::chrono::duration<f64, std::milli>(last_ready - first_submit).count();
+        std::cout << "shaders: " << warm_n << " warm, " << cold_n << " cold";
+        if (failed_n)
+            std::cout << ", " << failed_n << " failed";
+        std::cout << ", " << submit_ms << " ms to submit, all ready after " << ready_ms << " ms\n";
+        *this = {};
+    }
+};
+
+inline ShaderSummary &shader_summary() {
+    static ShaderSummary instance;
+    return instance;
+}
+
+// Programs come from the ProgramCache when possible and are otherwise
+// compiled from source. Compilation is only submitted in the constructor:
+// with KHR_parallel_shader_compile the driver compiles in the background
+// and `is_ready` polls it without blocking, so scenes can construct all
+// their shaders up front and overlap the compiles. Anything that needs the
+// linked program (`use`, `uniform`) finishes it first, blocking if needed.
 struct Shader {
+    using clock = std::chrono::steady_clock;
+
     uint32_t shader_program_id;
+    u64 cache_key = 0;
+    ShaderStats stats;
 
     Shader(const char *const vert_src, const char *const frag_src) {
-        auto attach_shader = [](auto program_id, auto shader_type, auto shader_code) {
-            auto shader_id = glCreateShader(shader_type);
-            glShaderSource(shader_id, 1, &shader_code, nullptr);
-            glCompileShader(shader_id);
-            int32_t param;
-            glGetShaderiv(shader_id, GL_COMPILE_STATUS, &param);
-            if (param == GL_FALSE) {
-                param = 0;
-                glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &param);
-                std::vector<char> info_log(static_cast<size_t>(param) + 100);
-                glGetShaderInfoLog(shader_id, param, &param, &info_log[0]);
-                glDeleteShader(shader_id);
-                std::cout << info_log.data() << '\n';
-            }
-            glAttachShader(program_id, shader_id);
-            return shader_id;
-        };
+        PROFILE_SCOPE("shader_submit");
+        start = clock::now();
         shader_program_id = glCreateProgram();
-        auto vert_shader_id = attach_shader(shader_program_id, GL_VERTEX_SHADER, vert_src);
-        auto frag_shader_id = attach_shader(shader_program_id, GL_FRAGMENT_SHADER, frag_src);
-        glLinkProgram(shader_program_id);
-        glDetachShader(shader_program_id, vert_shader_id);
-        glDetachShader(shader_program_id, frag_shader_id);
-        glDeleteShader(vert_shader_id);
-        glDeleteShader(frag_shader_id);
+        cache_key = ProgramCache::key(vert_src, frag_src);
+        if (ProgramCache::load(cache_key, shader_program_id)) {
+            stats.from_cache = true;
+        } else {
+            glProgramParameteri(shader_program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            auto attach_shader = [](auto program_id, auto shader_type, auto shader_code) {
+                auto shader_id = glCreateShader(shader_type);
+                glShaderSource(shader_id, 1, &shader_code, nullptr);
+                glCompileShader(shader_id);
+                glAttachShader(program_id, shader_id);
+                return shader_id;
+            };
+            vert_shader_id = attach_shader(shader_program_id, GL_VERTEX_SHADER, vert_src);
+            frag_shader_id = attach_shader(shader_program_id, GL_FRAGMENT_SHADER, frag_src);
+            glLinkProgram(shader_program_id);
+        }
+        pending = true;
+        stats.submit_ms = std::chrono::duration<f64, std::milli>(clock::now() - start).count();
+        shader_summary().submitted(start);
     }
 
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
     ~Shader() {
+        if (pending)
+            shader_summary().abandoned();
+        delete_stages();
+        gl_state().forget_program(shader_program_id);
         glDeleteProgram(shader_program_id);
     }
 
+    // Never blocks when the driver supports parallel compilation.
+    bool is_ready() {
+        if (!pending)
+            return true;
+        if (ProgramCache::has_parallel_compile()) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(shader_program_id, GL_COMPLETION_STATUS_KHR, &done);
+            if (done != GL_TRUE)
+                return false;
+        }
+        finish();
+        return true;
+    }
+
+    // Waits for the link, reports compile/link errors, and stores the
+    // binary of freshly compiled programs. The timings go into `stats` and
+    // the startup summary.
+    void finish() {
+        if (!pending)
+            return;
+        PROFILE_SCOPE("shader_finish");
+        pending = false;
+        auto print_log = [](u32 id, bool is_program) {
+            int32_t param = 0;
+            if (is_program)
+                glGetProgramiv(id, GL_INFO_LOG_LENGTH, &param);
+            else
+                glGetShaderiv(id, GL_INFO_LOG_LENGTH, &param);
+            std::vector<char> info_log(static_cast<size_t>(param) + 100);
+            if (is_program)
+                glGetProgramInfoLog(id, param, &param, &info_log[0]);
+            else
+                glGetShaderInfoLog(id, param, &param, &info_log[0]);
+            std::cout << info_log.data() << '\n';
+        };
+        for (auto shader_id : {vert_shader_id, frag_shader_id}) {
+            if (!shader_id)
+                continue;
+            int32_t param;
+            glGetShaderiv(shader_id, GL_COMPILE_STATUS, &param);
+            if (param == GL_FALSE)
+                print_log(shader_id, false);
+        }
+        int32_t linked = GL_FALSE;
+        glGetProgramiv(shader_program_id, GL_LINK_STATUS, &linked);
+        stats.linked = linked == GL_TRUE;
+        if (!stats.linked)
+            print_log(shader_program_id, true);
+        else if (!stats.from_cache)
+            ProgramCache::store(cache_key, shader_program_id);
+        delete_stages();
+        stats.ready_ms = std::chrono::duration<f64, std::milli>(clock::now() - start).count();
+        shader_summary().finished(stats);
+    }
+
     void use() {
-        glUseProgram(shader_program_id);
+        finish();
+        gl_state().use_program(shader_program_id);
+    }
+
+    // For recording DrawPackets; finishes the program like `use`.
+    u32 id() {
+        finish();
+        return shader_program_id;
     }
 
     Uniform uniform(const char *const name) {
+        finish();
         return {.location = glGetUniformLocation(shader_program_id, name)};
     }
+
+    BlockLayout uniform_block(const char *const name) {
+        finish();
+        return reflect_block(shader_program_id, GL_UNIFORM_BLOCK, name);
+    }
+    BlockLayout storage_block(const char *const name) {
+        finish();
+        return reflect_block(shader_program_id, GL_SHADER_STORAGE_BLOCK, name);
+    }
+
+  private:
+    clock::time_point start;
+    u32 vert_shader_id = 0, frag_shader_id = 0;
+    bool pending = false;
+
+    void delete_stages() {
+        for (auto *shader_id : {&vert_shader_id, &frag_shader_id}) {
+            if (!*shader_id)
+                continue;
+            glDetachShader(shader_program_id, *shader_id);
+            glDeleteShader(*shader_id);
+            *shader_id = 0;
+        }
+    }
+};
+
+// Camera data shared by every draw of a frame. Scenes declare it as
+//
+//     layout(std140, binding = 0) uniform Frame { mat4 proj_mat; mat4 view_mat; };
+struct FrameUniforms {
+    static constexpr u32 BINDING = 0;
+
+    f32mat4 proj_mat;
+    f32mat4 view_mat;
+
+    static bool check(Shader &shader) {
+        return check_block_layout<FrameUniforms>(shader.uniform_block("Frame"), {
+            {"proj_mat", offsetof(FrameUniforms, proj_mat)},
+            {"view_mat", offsetof(FrameUniforms, view_mat)},
+        });
+    }
 };
 
 struct Texture {
     uint32_t id;
 
     Texture(const u8 *bitmap_data, size_t sx, size_t sy) {
-        glGenTextures(1, &id);
-        glBindTexture(GL_TEXTURE_2D, id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, static_cast<GLsizei>(sx), static_cast<GLsizei>(sy), 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap_data);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        // DSA, so creating a texture doesn't disturb the cached unit bindings
+        glCreateTextures(GL_TEXTURE_2D, 1, &id);
+        glTextureStorage2D(id, 1, GL_RGBA8, static_cast<GLsizei>(sx), static_cast<GLsizei>(sy));
+        glTextureSubImage2D(id, 0, 0, 0, static_cast<GLsizei>(sx), static_cast<GLsizei>(sy), GL_RGBA, GL_UNSIGNED_BYTE, bitmap_data);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    // Full mip chain, possibly block-compressed, with trilinear filtering.
+    Texture(const TextureData &data) {
+        id = create_gl_texture(data);
+        for (size_t i = 0; i < data.levels.size(); ++i)
+            upload_gl_texture_level(id, data, i, data.levels[i].data.data());
     }
 
     ~Texture() {
+        gl_state().forget_texture(id);
         glDeleteTextures(1, &id);
     }
 
     void bind_slot(u32 slot) {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(GL_TEXTURE_2D, id);
+        gl_state().bind_texture_unit(slot, id);
     }
 };
 
 struct AttribDesc {
     u32 size, type;
+    // Integer types are converted to float in the shader: normalized maps
+    // them to [0, 1]/[-1, 1], otherwise the raw value is used. `integer`
+    // keeps them as ints (ivec/uvec inputs) instead.
+    bool normalized = false;
+    bool integer = false;
 };
 
 struct Mesh {
+    // vertex buffer binding of the per-instance stream
+    static constexpr u32 INSTANCE_BINDING = 1;
+
     uint32_t vao_id;
     uint32_t vbo_id;
     uint32_t ibo_id;
+    uint32_t instance_vbo_id = 0;
 
     size_t vertex_size = 0;
     size_t vertices_n = 0;
     size_t indices_n = 0;
     size_t max_vertices_n = 0;
     size_t max_indices_n = 0;
+    u32 attrib_n = 0;
+    size_t instance_size = 0;
+    size_t instances_n = 0;
+    size_t max_instances_n = 0;
 
     f32mat4 modl_mat;
 
+    static size_t gl_attrib_type_size(u32 type) {
+        switch (type) {
+        case GL_FLOAT: return sizeof(float);
+        case GL_INT:
+        case GL_UNSIGNED_INT: return sizeof(u32);
+        case GL_HALF_FLOAT:
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT: return sizeof(u16);
+        default: return 1;
+        }
+    }
+
     Mesh(const std::initializer_list<AttribDesc> &attribs) {
         glCreateVertexArrays(1, &vao_id);
         glCreateBuffers(1, &vbo_id);
-        auto gl_attrib_type_size = [](u32 type) -> size_t {
-            switch (type) {
-            case GL_FLOAT: return sizeof(float);
-            default: return 1;
-            }
-        };
         u32 index = 0;
         u32 offset = 0;
         for (const auto &attrib : attribs) {
             glEnableVertexArrayAttrib(vao_id, index);
             glVertexArrayAttribBinding(vao_id, index, 0);
-            glVertexArrayAttribFormat(vao_id, index, attrib.size, attrib.type, GL_FALSE, offset);
+            if (attrib.integer) {
+                glVertexArrayAttribIFormat(vao_id, index, attrib.size, attrib.type, offset);
+            } else {
+                glVertexArrayAttribFormat(vao_id, index, attrib.size, attrib.type, attrib.normalized ? GL_TRUE : GL_FALSE, offset);
+            }
             offset += static_cast<u32>(gl_attrib_type_size(attrib.type) * attrib.size);
             index++;
         }
         glVertexArrayVertexBuffer(vao_id, 0, vbo_id, 0, offset);
         vertex_size = offset;
+        attrib_n = index;
     }
 
     Mesh(const Mesh &) = delete;
@@ -163,14 +389,26 @@ struct Mesh {
         indices_n = other.indices_n;
         max_vertices_n = other.max_vertices_n;
         max_indices_n = other.max_indices_n;
+        instance_vbo_id = other.instance_vbo_id;
+        attrib_n = other.attrib_n;
+        instance_size = other.instance_size;
+        instances_n = other.instances_n;
+        max_instances_n = other.max_instances_n;
         modl_mat = other.modl_mat;
         other.vao_id = std::numeric_limits<uint32_t>::max();
         other.vbo_id = std::numeric_limits<uint32_t>::max();
         other.ibo_id = std::numeric_limits<uint32_t>::max();
+        other.instance_vbo_id = 0;
         return *this;
     }
 
     ~Mesh() {
+        auto &state = gl_state();
+        state.forget_buffer(ibo_id);
+        state.forget_buffer(vbo_id);
+        state.forget_buffer(instance_vbo_id);
+        state.forget_vertex_array(vao_id);
+        glDeleteBuffers(1, &instance_vbo_id);
         glDeleteBuffers(1, &ibo_id);
         glDeleteBuffers(1, &vbo_id);
         glDeleteVertexArrays(1, &vao_id);
@@ -200,16 +438,96 @@ struct Mesh {
         set_data(list.data(), list.size() * sizeof(list[0]), usage);
     }
 
+    // Adds a second vertex stream that advances once per instance, in the
+    // locations after the vertex attributes. A mat4 input takes four
+    // consecutive vec4 attributes.
+    void use_instance_attribs(std::span<const AttribDesc> attribs) {
+        glCreateBuffers(1, &instance_vbo_id);
+        u32 offset = 0;
+        for (const auto &attrib : attribs) {
+            glEnableVertexArrayAttrib(vao_id, attrib_n);
+            glVertexArrayAttribBinding(vao_id, attrib_n, INSTANCE_BINDING);
+            if (attrib.integer) {
+                glVertexArrayAttribIFormat(vao_id, attrib_n, attrib.size, attrib.type, offset);
+            } else {
+                glVertexArrayAttribFormat(vao_id, attrib_n, attrib.size, attrib.type, attrib.normalized ? GL_TRUE : GL_FALSE, offset);
+            }
+            offset += static_cast<u32>(gl_attrib_type_size(attrib.type) * attrib.size);
+            attrib_n++;
+        }
+        glVertexArrayBindingDivisor(vao_id, INSTANCE_BINDING, 1);
+        instance_size = offset;
+    }
+    void use_instance_attribs(const std::initializer_list<AttribDesc> &attribs) {
+        use_instance_attribs(std::span<const AttribDesc>(attribs.begin(), attribs.size()));
+    }
+
+    // Replaces the instance data, typically every frame. The buffer is
+    // orphaned before the upload so the driver never waits on draws still
+    // reading the previous contents, and only reallocated when it grows.
+    void set_instance_data(const void *data, size_t size) {
+        instances_n = size / instance_size;
+        if (instances_n > max_instances_n)
+            max_instances_n = std::max(instances_n, max_instances_n * 2);
+        auto capacity = static_cast<GLsizeiptr>(std::max<size_t>(max_instances_n, 1) * instance_size);
+        glNamedBufferData(instance_vbo_id, capacity, nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glNamedBufferSubData(instance_vbo_id, 0, static_cast<GLsizeiptr>(size), data);
+        glVertexArrayVertexBuffer(vao_id, INSTANCE_BINDING, instance_vbo_id, 0, static_cast<GLsizei>(instance_size));
+    }
+    void set_instance_data(const auto &list) {
+        set_instance_data(list.data(), list.size() * sizeof(list[0]));
+    }
+
     void draw() const {
-        glBindVertexArray(vao_id);
+        gl_state().bind_vertex_array(vao_id);
         if (max_indices_n == 0) {
             glDrawArrays(GL_TRIANGLES, 0, static_cast<u32>(vertices_n));
         } else {
             glDrawElements(GL_TRIANGLES, static_cast<u32>(indices_n), GL_UNSIGNED_INT, nullptr);
         }
     }
+
+    // Draws `count` copies in one call; instanced attributes come from
+    // `set_instance_data`, and shaders can also index by gl_InstanceID.
+    void draw_instanced(size_t count) const {
+        if (count == 0)
+            return;
+        gl_state().bind_vertex_array(vao_id);
+        if (max_indices_n == 0) {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices_n), static_cast<GLsizei>(count));
+        } else {
+            glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(indices_n), GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(count));
+        }
+    }
+    void draw_instanced() const {
+        draw_instanced(instances_n);
+    }
+
+    // The draw `draw` issues, deferred through a CommandQueue.
+    DrawPacket packet(u64 key, u32 program_id) const {
+        return {
+            .key = key,
+            .program_id = program_id,
+            .vertex_array_id = vao_id,
+            .count = static_cast<u32>(max_indices_n == 0 ? vertices_n : indices_n),
+            .indexed = max_indices_n != 0,
+        };
+    }
 };
 
+// InstanceData as an instance stream, for `use_instance_attribs`:
+//
+//     layout(location = N) in mat4 i_modl_mat;
+//     layout(location = N + 4) in vec4 i_col;
+inline constexpr std::array<AttribDesc, 5> INSTANCE_DATA_ATTRIBS = {{
+    {.size = 4, .type = GL_FLOAT},
+    {.size = 4, .type = GL_FLOAT},
+    {.size = 4, .type = GL_FLOAT},
+    {.size = 4, .type = GL_FLOAT},
+    {.size = 4, .type = GL_FLOAT},
+}};
+
 struct StaticMesh : Mesh {
     StaticMesh(const std::initializer_list<AttribDesc> &attribs) : Mesh(attribs) {}
 
@@ -231,84 +549,545 @@ struct StaticMesh : Mesh {
     }
 };
 
+// Geometry rewritten every frame (e.g. UI quads). Each stream is one
+// persistently mapped, write-only buffer split into FRAME_N regions that
+// are fenced like the UniformRing's, so `begin` only waits if the GPU is
+// still FRAME_N - 1 frames behind, never on a driver map. Pushing past
+// the capacity grows the buffers (doubling) instead of writing out of
+// bounds; the data already pushed this frame is copied over on the GPU.
+//
+// Indices are relative to the frame's first vertex; `draw` applies the
+// region offsets with a base vertex. When drawing through a CommandQueue
+// instead, call `fence` once the queue has been submitted.
 struct DynamicMesh : Mesh {
-    uint8_t *mapped_vbo;
-    uint8_t *mapped_ibo;
+    static constexpr size_t FRAME_N = 3;
+    static constexpr size_t MIN_CAPACITY = 1024;
 
-    DynamicMesh(const std::initializer_list<AttribDesc> &attribs) : Mesh(attribs) {}
+    struct Stream {
+        u8 *ptr = nullptr;
+        // elements per frame region
+        size_t capacity = 0;
+        size_t element_size = 0;
+    };
 
-    void set_index_data(const void *data, size_t size) {
-        Mesh::set_index_data(data, size, static_cast<u32>(GL_DYNAMIC_DRAW));
-    }
-    void set_index_data(const auto &list) {
-        Mesh::set_index_data(list.data(), list.size() * sizeof(list[0]), static_cast<u32>(GL_DYNAMIC_DRAW));
+    Stream vertex_stream, index_stream;
+    bool indexed = false;
+    std::array<GLsync, FRAME_N> frame_fences{};
+    size_t frame_i = 0;
+    u32 grow_n = 0;
+
+    DynamicMesh(const std::initializer_list<AttribDesc> &attribs) : Mesh(attribs) {
+        vertex_stream.element_size = vertex_size;
+        index_stream.element_size = sizeof(u32);
+        // replaced by immutable storage on the first reserve
+        gl_state().forget_buffer(vbo_id);
+        glDeleteBuffers(1, &vbo_id);
+        vbo_id = 0;
+        ibo_id = 0;
     }
-    void use_ibo(auto &&...args) {
-        Mesh::use_ibo(args..., static_cast<u32>(GL_DYNAMIC_DRAW));
+
+    DynamicMesh(const DynamicMesh &) = delete;
+    DynamicMesh &operator=(const DynamicMesh &) = delete;
+
+    ~DynamicMesh() {
+        for (auto fence : frame_fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
     }
 
+    // Sets the per-frame capacity to `size` bytes; `data`, if given,
+    // becomes the current frame's contents.
     void set_data(const void *data, size_t size) {
-        Mesh::set_data(data, size, static_cast<u32>(GL_DYNAMIC_DRAW));
+        reserve(vertex_stream, vbo_id, size / vertex_size);
+        max_vertices_n = vertex_stream.capacity;
+        vertices_n = 0;
+        if (data)
+            push(vertex_stream, vbo_id, vertices_n, data, size);
     }
     void set_data(const auto &list) {
-        Mesh::set_data(list.data(), list.size() * sizeof(list[0]), static_cast<u32>(GL_DYNAMIC_DRAW));
+        set_data(list.data(), list.size() * sizeof(list[0]));
+    }
+
+    void set_index_data(const void *data, size_t size) {
+        indexed = true;
+        reserve(index_stream, ibo_id, size / sizeof(u32));
+        max_indices_n = index_stream.capacity;
+        indices_n = 0;
+        if (data)
+            push(index_stream, ibo_id, indices_n, data, size);
+    }
+    void set_index_data(const auto &list) {
+        set_index_data(list.data(), list.size() * sizeof(list[0]));
+    }
+    void use_ibo(auto &&...args) {
+        set_index_data(args...);
     }
 
+    // Moves to the next frame region, waiting until the GPU is done with it.
     void begin() {
-        mapped_vbo = reinterpret_cast<uint8_t *>(glMapNamedBuffer(vbo_id, GL_READ_WRITE));
-        vertices_n = 0;
-        if (max_indices_n > 0) {
-            mapped_ibo = reinterpret_cast<uint8_t *>(glMapNamedBuffer(ibo_id, GL_READ_WRITE));
-            indices_n = 0;
+        frame_i = (frame_i + 1) % FRAME_N;
+        auto &fence = frame_fences[frame_i];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+            glDeleteSync(fence);
+            fence = nullptr;
         }
+        vertices_n = 0;
+        indices_n = 0;
     }
     void push_vertices(const auto &list) {
-        const auto data_size = list.size() * sizeof(list[0]);
-        std::memcpy(mapped_vbo, list.data(), data_size);
-        mapped_vbo += data_size;
-        vertices_n += data_size / vertex_size;
+        push(vertex_stream, vbo_id, vertices_n, list.data(), list.size() * sizeof(list[0]));
     }
     void push_indices(const auto &list) {
-        const auto data_size = list.size() * sizeof(list[0]);
-        std::memcpy(mapped_ibo, list.data(), data_size);
-        mapped_ibo += data_size;
-        indices_n += data_size / sizeof(u32);
-    }
-    void end() {
-        glUnmapNamedBuffer(vbo_id);
-        if (max_indices_n > 0) {
-            glUnmapNamedBuffer(ibo_id);
+        indexed = true;
+        push(index_stream, ibo_id, indices_n, list.data(), list.size() * sizeof(list[0]));
+    }
+    // The mappings are coherent, so there is nothing to flush.
+    void end() {}
+
+    void draw() {
+        if (vertices_n == 0)
+            return;
+        gl_state().bind_vertex_array(vao_id);
+        if (indexed) {
+            const auto *offset = reinterpret_cast<const void *>(frame_i * index_stream.capacity * sizeof(u32));
+            glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(indices_n), GL_UNSIGNED_INT, offset, static_cast<GLint>(frame_i * vertex_stream.capacity));
+        } else {
+            glDrawArrays(GL_TRIANGLES, static_cast<GLint>(frame_i * vertex_stream.capacity), static_cast<GLsizei>(vertices_n));
         }
+        fence();
     }
+
+    DrawPacket packet(u64 key, u32 program_id) const {
+        auto result = Mesh::packet(key, program_id);
+        result.indexed = indexed;
+        if (indexed) {
+            result.count = static_cast<u32>(indices_n);
+            result.first = static_cast<u32>(frame_i * index_stream.capacity);
+            result.base_vertex = static_cast<i32>(frame_i * vertex_stream.capacity);
+        } else {
+            result.count = static_cast<u32>(vertices_n);
+            result.first = static_cast<u32>(frame_i * vertex_stream.capacity);
+        }
+        return result;
+    }
+
+    // Marks the current region as in use by everything issued so far.
+    void fence() {
+        auto &fence = frame_fences[frame_i];
+        if (fence)
+            glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+  private:
+    void push(Stream &stream, u32 &buffer_id, size_t &n, const void *data, size_t size) {
+        size_t count = size / stream.element_size;
+        if (n + count > stream.capacity) {
+            size_t new_capacity = std::max(stream.capacity, MIN_CAPACITY);
+            while (new_capacity < n + count)
+                new_capacity *= 2;
+            reserve(stream, buffer_id, new_capacity, n);
+            ++grow_n;
+            if (&stream == &vertex_stream)
+                max_vertices_n = stream.capacity;
+            else
+                max_indices_n = stream.capacity;
+        }
+        std::memcpy(stream.ptr + (frame_i * stream.capacity + n) * stream.element_size, data, count * stream.element_size);
+        n += count;
+    }
+
+    // Reallocates `stream` with room for `capacity` elements per frame,
+    // keeping the first `keep_n` elements of the current frame.
+    void reserve(Stream &stream, u32 &buffer_id, size_t capacity, size_t keep_n = 0) {
+        if (capacity <= stream.capacity && buffer_id)
+            return;
+        capacity = std::max(capacity, stream.capacity);
+        u32 new_id;
+        glCreateBuffers(1, &new_id);
+        auto flags = static_cast<GLbitfield>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        auto size = static_cast<GLsizeiptr>(std::max<size_t>(capacity, 1) * stream.element_size * FRAME_N);
+        glNamedBufferStorage(new_id, size, nullptr, flags);
+        auto *new_ptr = reinterpret_cast<u8 *>(glMapNamedBufferRange(new_id, 0, size, flags));
+        if (buffer_id) {
+            if (keep_n > 0) {
+                glCopyNamedBufferSubData(buffer_id, new_id,
+                                         static_cast<GLintptr>(frame_i * stream.capacity * stream.element_size),
+                                         static_cast<GLintptr>(frame_i * capacity * stream.element_size),
+                                         static_cast<GLsizeiptr>(keep_n * stream.element_size));
+            }
+            // GL keeps the storage alive until in-flight draws are done
+            gl_state().forget_buffer(buffer_id);
+            glUnmapNamedBuffer(buffer_id);
+            glDeleteBuffers(1, &buffer_id);
+        }
+        buffer_id = new_id;
+        stream.ptr = new_ptr;
+        stream.capacity = capacity;
+        if (&stream == &vertex_stream)
+            glVertexArrayVertexBuffer(vao_id, 0, vbo_id, 0, static_cast<GLsizei>(vertex_size));
+        else
+            glVertexArrayElementBuffer(vao_id, ibo_id);
+    }
+};
+
+struct DrawElementsIndirectCommand {
+    u32 count;
+    u32 instance_count;
+    u32 first_index;
+    i32 base_vertex;
+    u32 base_instance;
 };
 
+struct LodStats {
+    // over all draws, at full detail and at the selected LODs
+    u64 full_triangle_n = 0;
+    u64 selected_triangle_n = 0;
+    // selected LODs of the draws that survived culling
+    u64 drawn_triangle_n = 0;
+};
+
+// All nodes of a model share one VAO/VBO/IBO and are drawn with a single
+// glMultiDrawElementsIndirect. Per-node model matrices live in an SSBO at
+// binding MODL_MATS_BINDING, which shaders index with gl_DrawID:
+//
+//     layout(std430, binding = 2) readonly buffer ModlMats { mat4 modl_mats[]; };
+//     mat4 modl_mat = modl_mats[gl_DrawID];
+//
+// After `pack_textures`, every draw samples its texture from one atlas
+// array bound at ATLAS_SLOT, through a per-draw region at binding
+// ATLAS_REGIONS_BINDING. Draws whose texture is missing or still loading
+// have a layer of 0xffffffff:
+//
+//     struct AtlasRegion { vec4 uv_rect; uint layer; };
+//     layout(std430, binding = 3) readonly buffer AtlasRegions { AtlasRegion atlas_regions[]; };
+//     layout(binding = 0) uniform sampler2DArray atlas;
+//     AtlasRegion r = atlas_regions[gl_DrawID];
+//     vec4 albedo = texture(atlas, vec3(r.uv_rect.xy + clamp(uv, 0, 1) * r.uv_rect.zw, r.layer));
 struct StaticModel {
-    std::vector<Mesh> meshes;
+    static constexpr u32 MODL_MATS_BINDING = 2;
+    static constexpr u32 ATLAS_REGIONS_BINDING = 3;
+    static constexpr u32 ATLAS_SLOT = 0;
+    static constexpr size_t OCCLUDER_TRIANGLE_BUDGET = 4096;
 
-    StaticModel(const std::initializer_list<AttribDesc> &attribs) {
-        meshes.push_back(attribs);
-    }
+    Mesh mesh;
+    std::shared_ptr<AssimpModelSource> source;
+    std::vector<DrawElementsIndirectCommand> draw_commands;
+    // Per-model copy of the source hierarchy. Animate it with
+    // `scene_graph.set_local` and call `update_transforms`; `node_mats` is
+    // the resulting world matrix per draw, and `modl_mats` additionally
+    // folds in the vertex dequantisation and is what the shaders see.
+    SceneGraph scene_graph;
+    std::vector<u32> node_scene_nodes;
+    std::vector<f32mat4> node_mats;
+    std::vector<f32mat4> dequantize_mats;
+    std::vector<f32mat4> modl_mats;
+    u32 indirect_buffer_id = 0;
+    u32 modl_mats_buffer_id = 0;
+
+    BoundsSoA world_bounds;
+    std::vector<u8> visible;
+    std::vector<u8> lod_levels;
+    CullStats cull_stats;
+    LodStats lod_stats;
+    DepthRasterizer depth_rasterizer;
+    // (clip w, node) of the visible nodes, nearest first; kept between
+    // frames so `cull` doesn't allocate
+    std::vector<std::pair<f32, size_t>> occluders;
+
+    // std430 layout of the GLSL AtlasRegion above
+    struct AtlasDrawRegion {
+        f32 uv_rect[4];
+        u32 layer;
+        u32 padding[3];
+    };
+    TextureAtlas *atlas = nullptr;
+    u32 atlas_generation = 0;
+    // per material, INVALID_HANDLE until its texture is in the atlas
+    std::vector<u32> material_atlas_handles;
+    // per material, the image still being decoded for the atlas
+    std::vector<std::shared_ptr<StreamedTexture>> atlas_images;
+    u32 atlas_regions_buffer_id = 0;
 
-    StaticModel(const std::filesystem::path &path) {
-        auto assimp_model = AssimpModel(path);
-        for (auto &node : assimp_model.source->nodes) {
-            meshes.push_back({
+    static Mesh make_mesh(VertexLayout layout) {
+        switch (layout) {
+        case VertexLayout::Packed:
+            return Mesh({
+                {.size = 4, .type = GL_UNSIGNED_SHORT, .normalized = true},
+                {.size = 2, .type = GL_SHORT, .normalized = true},
+                {.size = 2, .type = GL_HALF_FLOAT},
+            });
+        default:
+            return Mesh({
                 {.size = 3, .type = GL_FLOAT},
                 {.size = 3, .type = GL_FLOAT},
                 {.size = 2, .type = GL_FLOAT},
             });
-            auto &m = meshes.back();
-            m.set_data(node.vertices, static_cast<u32>(GL_STATIC_DRAW));
-            m.use_ibo(node.indices, static_cast<u32>(GL_STATIC_DRAW));
-            m.modl_mat = node.modl_mat;
         }
     }
 
-    void draw(const auto &fn) {
-        for (const auto &info : meshes) {
-            fn(info);
-            info.draw();
+    StaticModel(const std::filesystem::path &path, VertexLayout layout = VertexLayout::Float32) : mesh(make_mesh(layout)) {
+        source = AssimpModel(path).source;
+        // Node spans index into the source's shared blobs, so the offsets
+        // into those blobs become the per-draw base vertex / first index.
+        for (const auto &node : source->nodes) {
+            draw_commands.push_back({
+                .count = static_cast<u32>(node.indices.size()),
+                .instance_count = 1,
+                .first_index = static_cast<u32>(node.indices.data() - source->indices.data()),
+                .base_vertex = static_cast<i32>(node.vertices.data() - source->vertices.data()),
+                .base_instance = 0,
+            });
+            node_scene_nodes.push_back(node.scene_node);
+        }
+        scene_graph = source->scene_graph;
+        switch (layout) {
+        case VertexLayout::Float32: {
+            mesh.set_data(source->vertices, static_cast<u32>(GL_STATIC_DRAW));
+            dequantize_mats.resize(source->nodes.size(), f32mat4::identity());
+        } break;
+        case VertexLayout::Packed: {
+            std::vector<PackedVertex> packed_vertices(source->vertices.size());
+            for (size_t i = 0; i < source->nodes.size(); ++i) {
+                auto packed = pack_vertices(source->nodes[i].vertices);
+                std::copy(packed.vertices.begin(), packed.vertices.end(), packed_vertices.begin() + draw_commands[i].base_vertex);
+                dequantize_mats.push_back(packed.dequantize_mat());
+            }
+            mesh.set_data(packed_vertices, static_cast<u32>(GL_STATIC_DRAW));
+        } break;
+        }
+        mesh.use_ibo(source->indices, static_cast<u32>(GL_STATIC_DRAW));
+        node_mats.resize(draw_commands.size());
+        modl_mats.resize(draw_commands.size());
+        world_bounds.resize(draw_commands.size());
+        visible.resize(draw_commands.size(), 1);
+        lod_levels.resize(draw_commands.size(), 0);
+
+        // at least one element, since zero-sized storage is an error and an
+        // empty model (or one that failed to load) still needs the buffers
+        auto buffer_n = std::max<size_t>(draw_commands.size(), 1);
+        glCreateBuffers(1, &indirect_buffer_id);
+        glNamedBufferStorage(indirect_buffer_id, static_cast<GLsizeiptr>(buffer_n * sizeof(DrawElementsIndirectCommand)), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glNamedBufferSubData(indirect_buffer_id, 0, static_cast<GLsizeiptr>(draw_commands.size() * sizeof(DrawElementsIndirectCommand)), draw_commands.data());
+        glCreateBuffers(1, &modl_mats_buffer_id);
+        glNamedBufferStorage(modl_mats_buffer_id, static_cast<GLsizeiptr>(buffer_n * sizeof(f32mat4)), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        refresh_nodes(0, draw_commands.size());
+    }
+
+    StaticModel(const StaticModel &) = delete;
+    StaticModel &operator=(const StaticModel &) = delete;
+
+    ~StaticModel() {
+        auto &state = gl_state();
+        state.forget_buffer(atlas_regions_buffer_id);
+        state.forget_buffer(modl_mats_buffer_id);
+        state.forget_buffer(indirect_buffer_id);
+        glDeleteBuffers(1, &atlas_regions_buffer_id);
+        glDeleteBuffers(1, &modl_mats_buffer_id);
+        glDeleteBuffers(1, &indirect_buffer_id);
+    }
+
+    // Streams the first texture of kind `usage` of every material into
+    // `atlas_`, so the whole model draws with one texture bind. Images are
+    // decoded on the streamer's workers; `update_atlas` moves the finished
+    // ones into the atlas. The atlas must outlive the model.
+    void pack_textures(TextureAtlas &atlas_, TextureStreamer &streamer, TextureUsage usage = TextureUsage::Albedo) {
+        atlas = &atlas_;
+        for (auto handle : material_atlas_handles)
+            atlas->remove(handle);
+        material_atlas_handles.assign(source->materials.size(), TextureAtlas::INVALID_HANDLE);
+        atlas_images.clear();
+        for (const auto &material : source->materials) {
+            const auto &paths = usage == TextureUsage::Albedo ? material.albedo_texture_paths : material.normal_texture_paths;
+            atlas_images.push_back(paths.empty() ? nullptr : streamer.request(paths[0], usage, TextureTarget::Pixels));
         }
+        refresh_atlas_regions();
+    }
+
+    // Call once per frame, after `TextureStreamer::update`. Adds the images
+    // that finished decoding to the atlas (once per image, however many
+    // materials share it) and re-uploads the per-draw regions when they
+    // changed, including when another model's insertion repacked the atlas.
+    void update_atlas() {
+        if (!atlas)
+            return;
+        bool changed = atlas_generation != atlas->generation;
+        for (size_t i = 0; i < atlas_images.size(); ++i) {
+            auto image = atlas_images[i];
+            if (!image || !(image->ready || image->failed))
+                continue;
+            u32 handle = TextureAtlas::INVALID_HANDLE;
+            if (image->ready)
+                handle = atlas->add(image->pixels.data(), static_cast<u32>(image->size_x), static_cast<u32>(image->size_y));
+            for (size_t j = i; j < atlas_images.size(); ++j) {
+                if (atlas_images[j] == image) {
+                    material_atlas_handles[j] = handle;
+                    atlas_images[j] = nullptr;
+                }
+            }
+            changed = true;
+        }
+        if (changed)
+            refresh_atlas_regions();
+    }
+
+    // Images requested by `pack_textures` that are not in the atlas yet.
+    size_t atlas_pending_n() const {
+        return static_cast<size_t>(std::count_if(atlas_images.begin(), atlas_images.end(), [](const auto &image) { return image != nullptr; }));
+    }
+
+    void refresh_atlas_regions() {
+        if (!atlas)
+            return;
+        std::vector<AtlasDrawRegion> regions(draw_commands.size());
+        for (size_t i = 0; i < regions.size(); ++i) {
+            auto material = source->nodes[i].material;
+            auto region = material < material_atlas_handles.size() ? atlas->region(material_atlas_handles[material]) : AtlasRegion{};
+            regions[i] = {
+                .uv_rect = {region.uv_offset[0], region.uv_offset[1], region.uv_scale[0], region.uv_scale[1]},
+                .layer = region.layer,
+                .padding = {},
+            };
+        }
+        if (!atlas_regions_buffer_id) {
+            glCreateBuffers(1, &atlas_regions_buffer_id);
+            glNamedBufferStorage(atlas_regions_buffer_id, static_cast<GLsizeiptr>(std::max<size_t>(regions.size(), 1) * sizeof(AtlasDrawRegion)), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        }
+        glNamedBufferSubData(atlas_regions_buffer_id, 0, static_cast<GLsizeiptr>(regions.size() * sizeof(AtlasDrawRegion)), regions.data());
+        atlas_generation = atlas->generation;
+    }
+
+    // Call after changing local transforms in `scene_graph`. Only the draws
+    // under a changed subtree get new matrices and bounds, and each such
+    // subtree is uploaded as one contiguous range.
+    void update_transforms() {
+        scene_graph.update();
+        for (auto root : scene_graph.updated_roots) {
+            // draws are sorted by scene node, so a subtree maps to a range
+            auto first = std::lower_bound(node_scene_nodes.begin(), node_scene_nodes.end(), root);
+            auto last = std::lower_bound(first, node_scene_nodes.end(), scene_graph.subtree_ends[root]);
+            refresh_nodes(static_cast<size_t>(first - node_scene_nodes.begin()), static_cast<size_t>(last - node_scene_nodes.begin()));
+        }
+    }
+
+    // Picks the coarsest LOD per node whose error projects to at most
+    // `max_pixel_error` pixels. `pixels_per_unit` is the size in pixels of
+    // one world unit at distance 1, i.e. proj[1][1] * viewport_height / 2.
+    // Distance is the clip-space w of the nearest point of the node's
+    // bounding sphere, so this assumes a perspective projection.
+    void select_lods(const f32mat4 &view_proj, f32 pixels_per_unit, f32 max_pixel_error = 1.0f) {
+        PROFILE_SCOPE("select_lods");
+        size_t n = draw_commands.size();
+        lod_stats = {};
+        for (size_t i = 0; i < n; ++i) {
+            const auto &node = source->nodes[i];
+            f32 radius = std::sqrt(world_bounds.ex[i] * world_bounds.ex[i] + world_bounds.ey[i] * world_bounds.ey[i] + world_bounds.ez[i] * world_bounds.ez[i]);
+            f32 dist = transform_point(view_proj, {world_bounds.cx[i], world_bounds.cy[i], world_bounds.cz[i]})[3] - radius;
+            // LOD errors are in model space; scale by the largest axis scale
+            f32 scale = 0.0f;
+            for (size_t c = 0; c < 3; ++c)
+                scale = std::max(scale, std::sqrt(mat_elem(node_mats[i], 0, c) * mat_elem(node_mats[i], 0, c) + mat_elem(node_mats[i], 1, c) * mat_elem(node_mats[i], 1, c) + mat_elem(node_mats[i], 2, c) * mat_elem(node_mats[i], 2, c)));
+            u32 level = 0;
+            if (dist > 0.0f) {
+                while (level + 1 < node.lod_n && node.lods[level + 1].error * scale * pixels_per_unit / dist <= max_pixel_error)
+                    ++level;
+            }
+            const auto &lod = node.lods[level];
+            lod_levels[i] = static_cast<u8>(level);
+            draw_commands[i].count = static_cast<u32>(lod.indices.size());
+            draw_commands[i].first_index = static_cast<u32>(lod.indices.data() - source->indices.data());
+            lod_stats.full_triangle_n += node.indices.size() / 3;
+            lod_stats.selected_triangle_n += lod.indices.size() / 3;
+        }
+        lod_stats.drawn_triangle_n = lod_stats.selected_triangle_n;
+        glNamedBufferSubData(indirect_buffer_id, 0, static_cast<GLsizeiptr>(n * sizeof(DrawElementsIndirectCommand)), draw_commands.data());
+    }
+
+    // Frustum-culls every node against `view_proj` and, if `occlusion` is
+    // set, rasterises the nearest visible nodes into a small depth buffer
+    // and drops nodes hidden behind them. Nodes are tested nearest first,
+    // each before its own triangles go into the buffer, so a node is only
+    // ever tested against the ones in front of it. Culled draws keep their slot in
+    // the indirect buffer with an instance count of 0, so gl_DrawID stays
+    // a stable index into `modl_mats`.
+    void cull(const f32mat4 &view_proj, bool occlusion = false) {
+        PROFILE_SCOPE("cull");
+        size_t n = draw_commands.size();
+        if (n == 0)
+            return;
+        cull_stats = {.total_n = static_cast<u32>(n)};
+        frustum_cull(Frustum(view_proj), world_bounds, visible);
+
+        if (occlusion) {
+            occluders.clear();
+            for (size_t i = 0; i < n; ++i) {
+                if (!visible[i])
+                    continue;
+                auto center = transform_point(view_proj, {world_bounds.cx[i], world_bounds.cy[i], world_bounds.cz[i]});
+                occluders.push_back({center[3], i});
+            }
+            std::sort(occluders.begin(), occluders.end());
+            depth_rasterizer.clear();
+            size_t triangle_n = 0;
+            for (auto [dist, i] : occluders) {
+                if (depth_rasterizer.is_occluded(view_proj, world_bounds.min_corner(i), world_bounds.max_corner(i))) {
+                    visible[i] = 0;
+                    ++cull_stats.occlusion_culled_n;
+                    continue;
+                }
+                const auto &node = source->nodes[i];
+                // rasterise the selected LOD; coarser is cheaper and still
+                // close enough at this resolution
+                auto lod_indices = node.lods[lod_levels[i]].indices;
+                if (triangle_n + lod_indices.size() / 3 > OCCLUDER_TRIANGLE_BUDGET)
+                    continue;
+                triangle_n += lod_indices.size() / 3;
+                auto mvp = view_proj * node_mats[i];
+                for (size_t t = 0; t + 2 < lod_indices.size(); t += 3) {
+                    depth_rasterizer.rasterize_triangle(
+                        transform_point(mvp, node.vertices[lod_indices[t + 0]].pos),
+                        transform_point(mvp, node.vertices[lod_indices[t + 1]].pos),
+                        transform_point(mvp, node.vertices[lod_indices[t + 2]].pos));
+                }
+            }
+        }
+
+        lod_stats.drawn_triangle_n = 0;
+        for (size_t i = 0; i < n; ++i) {
+            draw_commands[i].instance_count = visible[i];
+            cull_stats.visible_n += visible[i];
+            lod_stats.drawn_triangle_n += visible[i] * (draw_commands[i].count / 3);
+        }
+        cull_stats.frustum_culled_n = cull_stats.total_n - cull_stats.visible_n - cull_stats.occlusion_culled_n;
+        glNamedBufferSubData(indirect_buffer_id, 0, static_cast<GLsizeiptr>(n * sizeof(DrawElementsIndirectCommand)), draw_commands.data());
+    }
+
+    void draw() const {
+        if (draw_commands.empty())
+            return;
+        auto &state = gl_state();
+        state.bind_vertex_array(mesh.vao_id);
+        state.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, MODL_MATS_BINDING, modl_mats_buffer_id);
+        if (atlas) {
+            atlas->bind_slot(ATLAS_SLOT);
+            state.bind_buffer_range(GL_SHADER_STORAGE_BUFFER, ATLAS_REGIONS_BINDING, atlas_regions_buffer_id);
+        }
+        state.bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_id);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(draw_commands.size()), 0);
+    }
+
+  private:
+    void refresh_nodes(size_t begin, size_t end) {
+        if (begin >= end)
+            return;
+        for (size_t i = begin; i < end; ++i) {
+            node_mats[i] = scene_graph.world_mats[node_scene_nodes[i]];
+            modl_mats[i] = node_mats[i] * dequantize_mats[i];
+            world_bounds.set(i, node_mats[i], source->nodes[i].bounds_min, source->nodes[i].bounds_max);
+        }
+        glNamedBufferSubData(modl_mats_buffer_id, static_cast<GLintptr>(begin * sizeof(f32mat4)), static_cast<GLsizeiptr>((end - begin) * sizeof(f32mat4)), modl_mats.data() + begin);
     }
 };
 
@@ -322,6 +1101,20 @@ struct RenderContext {
     }
 
     void flush() {
-        gl_ctx.swap_buffers();
+        {
+            PROFILE_SCOPE("swap_buffers");
+            gl_ctx.swap_buffers();
+        }
+        end_frame();
+    }
+
+    // Per-frame bookkeeping without presenting, for frames drawn offscreen.
+    void end_frame() {
+        shader_summary().report();
+        gl_state().end_frame();
+        scene_clock().advance();
+        // the profiler first, so the GPU timer tags its next frame right
+        profiler().end_frame();
+        gpu_timer().end_frame();
     }
 };
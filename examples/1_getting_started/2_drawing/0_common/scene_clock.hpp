@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+
+#include <cuiui/math/types.hpp>
+
+// Time the scenes animate by. It follows the steady clock unless given a
+// fixed step; then each `advance` moves it on by exactly that step, so a
+// headless run renders the same frames however fast it goes.
+struct SceneClock {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point start = clock::now();
+    f64 fixed_step = 0.0;
+    u64 frame = 0;
+
+    void reset() {
+        start = clock::now();
+        frame = 0;
+    }
+
+    // 0 goes back to real time.
+    void set_fixed_step(f64 step) {
+        fixed_step = step;
+        reset();
+    }
+
+    void advance() {
+        ++frame;
+    }
+
+    f32 seconds() const {
+        if (fixed_step > 0.0)
+            return static_cast<f32>(static_cast<f64>(frame) * fixed_step);
+        return std::chrono::duration<f32>(clock::now() - start).count();
+    }
+};
+
+inline SceneClock &scene_clock() {
+    static SceneClock instance;
+    return instance;
+}
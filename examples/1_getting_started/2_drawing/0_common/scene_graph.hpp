@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+// Flat transform hierarchy. Nodes are stored in depth-first pre-order, so
+// every parent comes before its children and each node's subtree is the
+// contiguous range [i, subtree_ends[i]). Changing a local matrix marks the
+// node dirty; `update` then only recomputes the dirty subtrees, in
+// parallel when there is enough work.
+struct SceneGraph {
+    static constexpr u32 NO_PARENT = std::numeric_limits<u32>::max();
+    static constexpr size_t PARALLEL_THRESHOLD = 4096;
+
+    std::vector<u32> parents;
+    std::vector<u32> subtree_ends;
+    std::vector<f32mat4> local_mats;
+    std::vector<f32mat4> world_mats;
+    std::vector<u8> dirty;
+    std::vector<u32> dirty_roots;
+    // Roots of the subtrees recomputed by the last `update`, sorted, so
+    // callers can refresh only what changed.
+    std::vector<u32> updated_roots;
+
+    size_t size() const {
+        return parents.size();
+    }
+
+    // Nodes must be added in depth-first pre-order: `parent` is NO_PARENT,
+    // the previously added node, or one of its ancestors.
+    u32 add_node(u32 parent, const f32mat4 &local_mat) {
+        auto i = static_cast<u32>(parents.size());
+        parents.push_back(parent);
+        subtree_ends.push_back(i + 1);
+        local_mats.push_back(local_mat);
+        world_mats.push_back(local_mat);
+        dirty.push_back(1);
+        dirty_roots.push_back(i);
+        for (u32 p = parent; p != NO_PARENT; p = parents[p])
+            subtree_ends[p] = i + 1;
+        return i;
+    }
+
+    void set_local(u32 i, const f32mat4 &local_mat) {
+        local_mats[i] = local_mat;
+        if (!dirty[i]) {
+            dirty[i] = 1;
+            dirty_roots.push_back(i);
+        }
+    }
+
+    void update() {
+        PROFILE_SCOPE("scene_graph_update");
+        auto &ranges = updated_roots;
+        ranges.clear();
+        if (dirty_roots.empty())
+            return;
+        std::sort(dirty_roots.begin(), dirty_roots.end());
+        // Drop roots that sit inside an earlier dirty subtree; what's left
+        // are disjoint ranges that can be swept independently.
+        size_t work_n = 0;
+        u32 covered_end = 0;
+        for (auto r : dirty_roots) {
+            if (r < covered_end)
+                continue;
+            ranges.push_back(r);
+            covered_end = subtree_ends[r];
+            work_n += subtree_ends[r] - r;
+        }
+        auto sweep = [&](size_t k) {
+            u32 begin = ranges[k], end = subtree_ends[begin];
+            for (u32 i = begin; i < end; ++i) {
+                u32 p = parents[i];
+                world_mats[i] = p == NO_PARENT ? local_mats[i] : world_mats[p] * local_mats[i];
+                dirty[i] = 0;
+            }
+        };
+        if (work_n >= PARALLEL_THRESHOLD && ranges.size() > 1) {
+            parallel_for(ranges.size(), sweep);
+        } else {
+            for (size_t k = 0; k < ranges.size(); ++k)
+                sweep(k);
+        }
+        dirty_roots.clear();
+    }
+};
@@ -3,3 +3,4 @@
 #include "triangle.hpp"
 #include "spinning_cube.hpp"
 #include "gonza.hpp"
+#include "instanced_cubes.hpp"
@@ -9,45 +9,89 @@ struct GonzaScene {
         R"glsl(
             #version 460 core
             layout(location = 0) in vec3 a_pos;
-            layout(location = 1) in vec3 a_col;
+            layout(location = 1) in vec2 a_nrm_oct;
             layout(location = 2) in vec2 a_tex;
             layout(location = 0) out vec3 v_col;
-            uniform mat4 proj_mat;
-            uniform mat4 view_mat;
-            uniform mat4 modl_mat;
+            layout(location = 1) out vec2 v_tex;
+            layout(location = 2) flat out uint v_draw;
+            layout(std140, binding = 0) uniform Frame { mat4 proj_mat; mat4 view_mat; };
+            layout(std430, binding = 2) readonly buffer ModlMats { mat4 modl_mats[]; };
+            vec3 oct_decode(vec2 e) {
+                vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+                if (n.z < 0.0)
+                    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+                return normalize(n);
+            }
             void main() {
-                vec4 world_pos = modl_mat * vec4(a_pos, 1);
-                v_col = a_col;
+                vec4 world_pos = modl_mats[gl_DrawID] * vec4(a_pos, 1);
+                v_col = oct_decode(a_nrm_oct);
+                v_tex = a_tex;
+                v_draw = uint(gl_DrawID);
                 gl_Position = proj_mat * view_mat * world_pos;
             }
         )glsl",
         R"glsl(
             #version 460 core
             layout(location = 0) in vec3 v_col;
+            layout(location = 1) in vec2 v_tex;
+            layout(location = 2) flat in uint v_draw;
             layout(location = 0) out vec4 o_col;
+            struct AtlasRegion { vec4 uv_rect; uint layer; };
+            layout(std430, binding = 3) readonly buffer AtlasRegions { AtlasRegion atlas_regions[]; };
+            layout(binding = 0) uniform sampler2DArray atlas;
             void main() {
-                o_col = vec4(v_col, 1);
+                vec3 col = v_col;
+                AtlasRegion r = atlas_regions[v_draw];
+                // before the wrap below, which would make the mip level
+                // jump to the smallest along every seam
+                vec2 uv_dx = dFdx(v_tex) * r.uv_rect.zw, uv_dy = dFdy(v_tex) * r.uv_rect.zw;
+                if (r.layer != 0xffffffffu) {
+                    // The atlas can't repeat, so wrap by hand. Without
+                    // tangents the normal map can't bend the normal, but
+                    // its z still darkens grooves and seams.
+                    vec2 uv = r.uv_rect.xy + fract(v_tex) * r.uv_rect.zw;
+                    vec3 detail = normalize(textureGrad(atlas, vec3(uv, r.layer), uv_dx, uv_dy).xyz * 2.0 - 1.0);
+                    col *= detail.z;
+                }
+                o_col = vec4(col, 1);
             }
         )glsl"
         // clang-format on
     );
 
-    Uniform shader_proj_mat = shader.uniform("proj_mat");
-    Uniform shader_view_mat = shader.uniform("view_mat");
-    Uniform shader_modl_mat = shader.uniform("modl_mat");
+    UniformRing uniforms;
 
-    StaticModel model = StaticModel("examples/0_assets/gonza/gonza.gltf");
+    // The materials only ship normal maps (four of 1024x1024), which get
+    // streamed into one atlas layer so the model still draws with a single
+    // texture bind.
+    TextureStreamer streamer;
+    TextureAtlas atlas = TextureAtlas(2 * (1024 + 2 * 2));
+    StaticModel model = StaticModel("examples/0_assets/gonza/gonza.gltf", VertexLayout::Packed);
 
     using clock = std::chrono::high_resolution_clock;
     clock::time_point start;
 
     f32 aspect = 1.0f;
+    f32 viewport_height = 400.0f;
 
     GonzaScene() {
+        FrameUniforms::check(shader);
+        model.pack_textures(atlas, streamer, TextureUsage::Normal);
         start = clock::now();
     }
 
+    // Blocks until every texture is in the atlas, for captures that must
+    // not depend on how fast the workers decode.
+    void finish_loading() {
+        while (model.atlas_pending_n() > 0) {
+            streamer.update();
+            model.update_atlas();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
     void draw() {
+        GPU_PROFILE_SCOPE("gonza");
         shader.use();
 
         // auto now = clock::now();
@@ -61,10 +105,13 @@ struct GonzaScene {
 
         auto view_mat = rotate(rotate(f32mat4::identity(), rot.y, {1, 0, 0}), rot.x, {0, 1, 0}) * translate(f32mat4::identity(), pos);
 
-        shader_proj_mat.send_mat4(proj_mat);
-        shader_view_mat.send_mat4(view_mat);
-        model.draw([&](const auto &mesh_info) {
-            shader_modl_mat.send_mat4(mesh_info.modl_mat);
-        });
+        uniforms.begin_frame();
+        uniforms.push(FrameUniforms{proj_mat, view_mat}).bind(GL_UNIFORM_BUFFER, FrameUniforms::BINDING);
+        model.select_lods(proj_mat * view_mat, mat_elem(proj_mat, 1, 1) * viewport_height * 0.5f);
+        model.cull(proj_mat * view_mat, true);
+        streamer.update();
+        model.update_atlas();
+        model.draw();
+        uniforms.end_frame();
     }
 };
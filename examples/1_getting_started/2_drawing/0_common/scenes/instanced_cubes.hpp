@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../render.hpp"
+#include <cuiui/math/utility.hpp>
+
+// A grid of cubes drawn with one instanced call; only the ones inside the
+// frustum are uploaded each frame.
+struct InstancedCubesScene {
+    static constexpr i32 GRID_N = 32;
+
+    Shader shader = Shader(
+        // clang-format off
+        R"glsl(
+            #version 460 core
+            layout(location = 0) in vec3 a_pos;
+            layout(location = 1) in mat4 i_modl_mat;
+            layout(location = 5) in vec4 i_col;
+            layout(location = 0) out vec3 v_col;
+            layout(std140, binding = 0) uniform Frame { mat4 proj_mat; mat4 view_mat; };
+            void main() {
+                v_col = i_col.rgb * (0.75 + 0.5 * a_pos.y);
+                gl_Position = proj_mat * view_mat * i_modl_mat * vec4(a_pos, 1);
+            }
+        )glsl",
+        R"glsl(
+            #version 460 core
+            layout(location = 0) in vec3 v_col;
+            layout(location = 0) out vec4 o_col;
+            void main() {
+                o_col = vec4(v_col, 1);
+            }
+        )glsl"
+        // clang-format on
+    );
+
+    UniformRing uniforms;
+
+    StaticMesh mesh = StaticMesh({
+        {.size = 3, .type = GL_FLOAT},
+    });
+    InstanceBatch<> instances;
+
+    f32 aspect = 1.0f;
+
+    InstancedCubesScene() {
+        FrameUniforms::check(shader);
+        mesh.set_data(std::array{
+            // clang-format off
+            -0.5f, -0.5f, -0.5f,   -0.5f,  0.5f, -0.5f,    0.5f, -0.5f, -0.5f,    0.5f,  0.5f, -0.5f,
+            -0.5f, -0.5f,  0.5f,    0.5f, -0.5f,  0.5f,   -0.5f,  0.5f,  0.5f,    0.5f,  0.5f,  0.5f,
+            -0.5f, -0.5f, -0.5f,    0.5f, -0.5f, -0.5f,   -0.5f, -0.5f,  0.5f,    0.5f, -0.5f,  0.5f,
+            -0.5f,  0.5f, -0.5f,   -0.5f,  0.5f,  0.5f,    0.5f,  0.5f, -0.5f,    0.5f,  0.5f,  0.5f,
+            -0.5f, -0.5f, -0.5f,   -0.5f, -0.5f,  0.5f,   -0.5f,  0.5f, -0.5f,   -0.5f,  0.5f,  0.5f,
+             0.5f, -0.5f, -0.5f,    0.5f,  0.5f, -0.5f,    0.5f, -0.5f,  0.5f,    0.5f,  0.5f,  0.5f,
+            // clang-format on
+        });
+        std::array<u32, 36> indices;
+        for (u32 face = 0; face < 6; ++face) {
+            const u32 quad[6] = {0, 1, 2, 1, 3, 2};
+            for (u32 k = 0; k < 6; ++k)
+                indices[face * 6 + k] = quad[k] + face * 4;
+        }
+        mesh.use_ibo(indices);
+        mesh.use_instance_attribs(INSTANCE_DATA_ATTRIBS);
+
+        for (i32 z = 0; z < GRID_N; ++z) {
+            for (i32 y = 0; y < GRID_N; ++y) {
+                for (i32 x = 0; x < GRID_N; ++x) {
+                    f32vec3 pos = {static_cast<f32>(x - GRID_N / 2) * 1.5f, static_cast<f32>(y - GRID_N / 2) * 1.5f, static_cast<f32>(-z) * 1.5f};
+                    auto modl_mat = translate(f32mat4::identity(), pos);
+                    f32vec4 col = {static_cast<f32>(x) / GRID_N, static_cast<f32>(y) / GRID_N, static_cast<f32>(z) / GRID_N, 1.0f};
+                    instances.add({modl_mat, col}, modl_mat, {-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f});
+                }
+            }
+        }
+    }
+
+    void draw() {
+        GPU_PROFILE_SCOPE("instanced_cubes");
+        shader.use();
+
+        auto elapsed = scene_clock().seconds();
+        auto proj_mat = perspective(radians(90.0f), aspect, 0.01f, 100.0f);
+        auto view_mat = rotate(translate(f32mat4::identity(), {0, 0, -4.0f}), elapsed * 0.3f, {0, 1, 0});
+
+        uniforms.begin_frame();
+        uniforms.push(FrameUniforms{proj_mat, view_mat}).bind(GL_UNIFORM_BUFFER, FrameUniforms::BINDING);
+        mesh.set_instance_data(instances.cull(proj_mat * view_mat));
+        mesh.draw_instanced();
+        uniforms.end_frame();
+    }
+};
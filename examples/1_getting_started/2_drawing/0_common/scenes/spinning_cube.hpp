@@ -11,9 +11,8 @@ struct SpinningCubeScene {
             layout(location = 0) in vec3 a_pos;
             layout(location = 1) in vec3 a_col;
             layout(location = 0) out vec3 v_col;
-            uniform mat4 proj_mat;
-            uniform mat4 view_mat;
-            uniform mat4 modl_mat;
+            layout(std140, binding = 0) uniform Frame { mat4 proj_mat; mat4 view_mat; };
+            layout(std140, binding = 1) uniform Draw { mat4 modl_mat; };
             void main() {
                 v_col = a_col;
                 gl_Position = proj_mat * view_mat * modl_mat * vec4(a_pos, 1);
@@ -30,21 +29,24 @@ struct SpinningCubeScene {
         // clang-format on
     );
 
-    Uniform shader_proj_mat = shader.uniform("proj_mat");
-    Uniform shader_view_mat = shader.uniform("view_mat");
-    Uniform shader_modl_mat = shader.uniform("modl_mat");
+    struct DrawUniforms {
+        static constexpr u32 BINDING = 1;
+        f32mat4 modl_mat;
+    };
+    UniformRing uniforms;
+    CommandQueue commands;
+    GlCommandBackend backend;
 
     StaticMesh mesh = StaticMesh({
         {.size = 3, .type = GL_FLOAT},
         {.size = 3, .type = GL_FLOAT},
     });
 
-    using clock = std::chrono::high_resolution_clock;
-    clock::time_point start;
-
     f32 aspect = 1.0f;
 
     SpinningCubeScene() {
+        FrameUniforms::check(shader);
+        check_block_layout<DrawUniforms>(shader.uniform_block("Draw"), {{"modl_mat", offsetof(DrawUniforms, modl_mat)}});
         mesh.set_data(std::array{
             // clang-format off
             -0.5f, -0.5f, -0.5f,   1.0f, 0.0f, 0.0f,
@@ -93,19 +95,26 @@ struct SpinningCubeScene {
     }
 
     void draw() {
-        shader.use();
-
-        auto now = clock::now();
-        auto start_diff = now - start;
-        auto elapsed = std::chrono::duration<float>(start_diff).count();
+        GPU_PROFILE_SCOPE("spinning_cube");
+        auto elapsed = scene_clock().seconds();
 
         auto proj_mat = (perspective(radians(90.0f), aspect, 0.01f, 100.0f));
         auto view_mat = translate(f32mat4::identity(), {0, 0, -1.5f});
         auto modl_mat = rotate(rotate(f32mat4::identity(), elapsed * 1.43f, {0, 1, 0}), elapsed * 0.41f, {1, 0, 0});
 
-        shader_proj_mat.send_mat4(proj_mat);
-        shader_view_mat.send_mat4(view_mat);
-        shader_modl_mat.send_mat4(modl_mat);
-        mesh.draw();
+        uniforms.begin_frame();
+        uniforms.push(FrameUniforms{proj_mat, view_mat}).bind(GL_UNIFORM_BUFFER, FrameUniforms::BINDING);
+        auto draw_uniforms = uniforms.push(DrawUniforms{modl_mat});
+
+        commands.clear();
+        auto packet = mesh.packet(SortKey::front_to_back(0, 0, 0, 1.5f), shader.id());
+        packet.uniform_buffer_id = draw_uniforms.buffer_id;
+        packet.uniform_binding = DrawUniforms::BINDING;
+        packet.uniform_offset = static_cast<u32>(draw_uniforms.offset);
+        packet.uniform_size = static_cast<u32>(draw_uniforms.size);
+        commands.new_list().push(packet);
+        commands.sort();
+        commands.submit(backend);
+        uniforms.end_frame();
     }
 };
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "model_cache.hpp"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// On-disk layout of a cached program binary:
+//
+//   ProgramCacheHeader
+//   u8 binary[binary_size]
+struct ProgramCacheHeader {
+    static constexpr u32 MAGIC = 0x47525043; // "CPRG"
+    static constexpr u32 VERSION = 1;
+
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 binary_format;
+    u32 binary_size;
+};
+
+// Persists linked programs with glGetProgramBinary, keyed by a hash of the
+// stage sources and the driver's renderer/version strings (binaries are
+// only valid for the driver that produced them, and it may reject them
+// anyway after an update, in which case the caller falls back to
+// compiling).
+struct ProgramCache {
+    static inline std::filesystem::path cache_dir = std::filesystem::temp_directory_path() / "coel_samples_shader_cache";
+
+    static u64 key(std::string_view vert_src, std::string_view frag_src) {
+        auto gl_string = [](GLenum name) {
+            const auto *str = reinterpret_cast<const char *>(glGetString(name));
+            return std::string_view(str ? str : "");
+        };
+        auto hash = fnv1a_hash(gl_string(GL_RENDERER));
+        hash = fnv1a_hash(gl_string(GL_VERSION), hash);
+        hash = fnv1a_hash(vert_src, hash);
+        // keep "ab" + "c" and "a" + "bc" apart
+        hash = fnv1a_hash(std::string_view("\0", 1), hash);
+        return fnv1a_hash(frag_src, hash);
+    }
+
+    static std::filesystem::path cache_path(u64 key) {
+        std::string name = "program_";
+        for (i32 shift = 60; shift >= 0; shift -= 4)
+            name += "0123456789abcdef"[(key >> shift) & 0xf];
+        return cache_dir / (name + ".bin");
+    }
+
+    // Whether the driver can hand out program binaries at all.
+    static bool is_supported() {
+        static const bool supported = []() {
+            GLint format_n = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_n);
+            return format_n > 0;
+        }();
+        return supported;
+    }
+
+    // KHR_parallel_shader_compile (or its ARB twin): compiles and links
+    // run on driver threads, and GL_COMPLETION_STATUS_KHR can be polled
+    // without blocking.
+    static bool has_parallel_compile() {
+        static const bool supported = []() {
+            GLint extension_n = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extension_n);
+            for (GLint i = 0; i < extension_n; ++i) {
+                const auto *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+                if (name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+                    return true;
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    // Loads the cached binary into `program_id`. Returns false on a miss
+    // or if the driver rejects the binary; `program_id` is then unlinked
+    // and can still be compiled from source.
+    static bool load(u64 key, u32 program_id) {
+        if (!is_supported())
+            return false;
+        auto file = MappedFile(cache_path(key));
+        if (!file.is_valid() || file.size < sizeof(ProgramCacheHeader))
+            return false;
+        ProgramCacheHeader header;
+        std::memcpy(&header, file.data, sizeof(header));
+        if (header.magic != ProgramCacheHeader::MAGIC || header.version != ProgramCacheHeader::VERSION ||
+            header.key != key || sizeof(header) + header.binary_size > file.size)
+            return false;
+        glProgramBinary(program_id, header.binary_format, file.data + sizeof(header), static_cast<GLsizei>(header.binary_size));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // `program_id` must be linked, with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    // set before linking.
+    static void store(u64 key, u32 program_id) {
+        if (!is_supported())
+            return;
+        GLint size = 0;
+        glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0)
+            return;
+        std::vector<u8> binary(static_cast<size_t>(size));
+        GLenum binary_format = 0;
+        glGetProgramBinary(program_id, size, &size, &binary_format, binary.data());
+        ProgramCacheHeader header{
+            .magic = ProgramCacheHeader::MAGIC,
+            .version = ProgramCacheHeader::VERSION,
+            .key = key,
+            .binary_format = binary_format,
+            .binary_size = static_cast<u32>(size),
+        };
+
+        std::error_code ec;
+        std::filesystem::create_directories(cache_dir, ec);
+        auto final_path = cache_path(key);
+        auto temp_path = final_path;
+        temp_path += ".tmp";
+        {
+            auto out = std::ofstream(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return;
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(binary.data()), static_cast<std::streamsize>(header.binary_size));
+            if (!out)
+                return;
+        }
+        std::filesystem::rename(temp_path, final_path, ec);
+        if (ec)
+            std::filesystem::remove(temp_path, ec);
+    }
+};
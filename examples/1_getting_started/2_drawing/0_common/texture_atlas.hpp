@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "rect_pack.hpp"
+
+// Where an image ended up: a layer of the atlas array texture and the
+// rectangle inside it, in normalised coordinates.
+struct AtlasRegion {
+    static constexpr u32 NO_LAYER = std::numeric_limits<u32>::max();
+
+    u32 layer = NO_LAYER;
+    f32vec2 uv_offset = {0.0f, 0.0f};
+    f32vec2 uv_scale = {1.0f, 1.0f};
+};
+
+// Packs many small RGBA8 images into the layers of one GL_TEXTURE_2D_ARRAY
+// so that everything using them binds a single texture. Each layer is
+// filled by a skyline packer; images get `padding` texels of replicated
+// edge around them so linear filtering doesn't bleed between neighbours.
+// The array has a full mip chain, built per image from its padded block,
+// so minified images filter instead of aliasing.
+//
+// Insertion is incremental. When no layer has room, the array first gets
+// repacked if enough of it is dead space from removed images, and
+// otherwise grows by doubling its layer count (old layers are copied on
+// the GPU). Repacking moves images, so anything holding on to a region
+// must re-query it when `generation` changes.
+struct TextureAtlas {
+    static constexpr u32 INVALID_HANDLE = std::numeric_limits<u32>::max();
+    // repack instead of growing once this much of the allocated area is dead
+    static constexpr f32 DEFRAG_DEAD_FRACTION = 0.25f;
+
+    struct Entry {
+        u32 layer;
+        // including padding
+        PackRect rect;
+        bool alive;
+    };
+
+    struct Stats {
+        u32 entry_n = 0;
+        u32 layer_n = 0;
+        u32 grow_n = 0;
+        u32 defrag_n = 0;
+        // live image texels / texels of all layers
+        f32 efficiency = 0.0f;
+        // texels claimed by the packers, live or dead / texels of all layers
+        f32 occupancy = 0.0f;
+        u64 bind_n = 0;
+    };
+
+    u32 size;
+    u32 padding;
+    u32 level_n;
+    u32 texture_id = 0;
+    u32 layer_capacity = 0;
+    u32 generation = 0;
+    std::vector<SkylinePacker> layers;
+    std::vector<Entry> entries;
+    std::vector<u32> free_handles;
+    u64 live_area = 0;
+    u64 dead_area = 0;
+    Stats stats;
+
+    TextureAtlas(u32 size_ = 1024, u32 padding_ = 2, u32 initial_layer_n = 1) : size(size_), padding(padding_), level_n(static_cast<u32>(std::bit_width(size_))) {
+        layer_capacity = std::max(initial_layer_n, 1u);
+        texture_id = create_array(layer_capacity);
+        layers.emplace_back(size, size);
+        update_stats();
+    }
+
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+    ~TextureAtlas() {
+        gl_state().forget_texture(texture_id);
+        glDeleteTextures(1, &texture_id);
+    }
+
+    // Returns INVALID_HANDLE if the image is larger than a layer.
+    u32 add(const u8 *rgba, u32 size_x, u32 size_y) {
+        u32 padded_x = size_x + padding * 2, padded_y = size_y + padding * 2;
+        if (size_x == 0 || size_y == 0 || padded_x > size || padded_y > size) {
+            std::cout << "ERROR::ATLAS::" << size_x << "x" << size_y << " image does not fit a " << size << "x" << size << " layer" << std::endl;
+            return INVALID_HANDLE;
+        }
+        auto placed = allocate(padded_x, padded_y);
+        if (!placed && dead_area >= static_cast<u64>(DEFRAG_DEAD_FRACTION * static_cast<f32>(allocated_area()))) {
+            defragment();
+            placed = allocate(padded_x, padded_y);
+        }
+        if (!placed) {
+            layers.emplace_back(size, size);
+            placed = allocate(padded_x, padded_y);
+        }
+        auto [layer, rect] = *placed;
+        if (layer >= layer_capacity)
+            grow(layer + 1);
+        upload_block(texture_id, pad_image(rgba, size_x, size_y, rect), layer, rect);
+
+        u32 handle;
+        if (!free_handles.empty()) {
+            handle = free_handles.back();
+            free_handles.pop_back();
+        } else {
+            handle = static_cast<u32>(entries.size());
+            entries.emplace_back();
+        }
+        entries[handle] = {layer, rect, true};
+        live_area += u64{size_x} * size_y;
+        update_stats();
+        return handle;
+    }
+
+    // The space is only reclaimed by the next `defragment`.
+    void remove(u32 handle) {
+        if (handle >= entries.size() || !entries[handle].alive)
+            return;
+        auto &entry = entries[handle];
+        entry.alive = false;
+        live_area -= u64{entry.rect.w - padding * 2} * (entry.rect.h - padding * 2);
+        dead_area += u64{entry.rect.w} * entry.rect.h;
+        free_handles.push_back(handle);
+        update_stats();
+    }
+
+    AtlasRegion region(u32 handle) const {
+        if (handle >= entries.size() || !entries[handle].alive)
+            return {};
+        const auto &entry = entries[handle];
+        auto inv_size = 1.0f / static_cast<f32>(size);
+        return {
+            .layer = entry.layer,
+            .uv_offset = {static_cast<f32>(entry.rect.x + padding) * inv_size, static_cast<f32>(entry.rect.y + padding) * inv_size},
+            .uv_scale = {static_cast<f32>(entry.rect.w - padding * 2) * inv_size, static_cast<f32>(entry.rect.h - padding * 2) * inv_size},
+        };
+    }
+
+    // Repacks every live image, tallest first, into fresh layers of a new
+    // array texture. Each padded block is read back and re-uploaded, since
+    // a block that moves by an odd number of texels lines up differently
+    // with the smaller levels' texels and needs its mips rebuilt.
+    void defragment() {
+        std::vector<u32> order;
+        for (u32 i = 0; i < entries.size(); ++i) {
+            if (entries[i].alive)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [this](u32 a, u32 b) {
+            const auto &ra = entries[a].rect, &rb = entries[b].rect;
+            return ra.h != rb.h ? ra.h > rb.h : ra.w > rb.w;
+        });
+        layers.assign(1, SkylinePacker(size, size));
+        std::vector<Entry> moved = entries;
+        for (auto i : order) {
+            auto placed = allocate(entries[i].rect.w, entries[i].rect.h);
+            if (!placed) {
+                layers.emplace_back(size, size);
+                placed = allocate(entries[i].rect.w, entries[i].rect.h);
+            }
+            moved[i].layer = placed->first;
+            moved[i].rect = placed->second;
+        }
+
+        u32 new_capacity = std::max(static_cast<u32>(layers.size()), 1u);
+        u32 new_id = create_array(new_capacity);
+        std::vector<u32> block;
+        for (auto i : order) {
+            const auto &from = entries[i], &to = moved[i];
+            block.resize(size_t{from.rect.w} * from.rect.h);
+            glGetTextureSubImage(texture_id, 0, static_cast<GLint>(from.rect.x), static_cast<GLint>(from.rect.y), static_cast<GLint>(from.layer),
+                                 static_cast<GLsizei>(from.rect.w), static_cast<GLsizei>(from.rect.h), 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                 static_cast<GLsizei>(block.size() * sizeof(u32)), block.data());
+            upload_block(new_id, block, to.layer, to.rect);
+        }
+        gl_state().forget_texture(texture_id);
+        glDeleteTextures(1, &texture_id);
+        texture_id = new_id;
+        layer_capacity = new_capacity;
+        entries = std::move(moved);
+        dead_area = 0;
+        ++generation;
+        ++stats.defrag_n;
+        update_stats();
+    }
+
+    void bind_slot(u32 slot) {
+        gl_state().bind_texture_unit(slot, texture_id);
+        ++stats.bind_n;
+    }
+
+  private:
+    u64 allocated_area() const {
+        u64 result = 0;
+        for (const auto &layer : layers)
+            result += layer.used_area;
+        return result;
+    }
+
+    std::optional<std::pair<u32, PackRect>> allocate(u32 w, u32 h) {
+        for (u32 i = 0; i < layers.size(); ++i) {
+            if (auto rect = layers[i].insert(w, h))
+                return std::pair{i, *rect};
+        }
+        return std::nullopt;
+    }
+
+    u32 create_array(u32 layer_n) const {
+        u32 id;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &id);
+        glTextureStorage3D(id, static_cast<GLsizei>(level_n), GL_RGBA8, static_cast<GLsizei>(size), static_cast<GLsizei>(size), static_cast<GLsizei>(layer_n));
+        glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return id;
+    }
+
+    void grow(u32 min_layer_n) {
+        u32 new_capacity = layer_capacity;
+        while (new_capacity < min_layer_n)
+            new_capacity *= 2;
+        u32 new_id = create_array(new_capacity);
+        for (u32 level = 0; level < level_n; ++level) {
+            auto level_size = static_cast<GLsizei>(std::max(size >> level, 1u));
+            glCopyImageSubData(texture_id, GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, 0, new_id, GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, 0,
+                               level_size, level_size, static_cast<GLsizei>(layer_capacity));
+        }
+        gl_state().forget_texture(texture_id);
+        glDeleteTextures(1, &texture_id);
+        texture_id = new_id;
+        layer_capacity = new_capacity;
+        ++stats.grow_n;
+    }
+
+    // The image with its edge replicated `padding` texels out, filling `rect`.
+    std::vector<u32> pad_image(const u8 *rgba, u32 size_x, u32 size_y, const PackRect &rect) const {
+        std::vector<u32> padded(size_t{rect.w} * rect.h);
+        const auto *src = reinterpret_cast<const u32 *>(rgba);
+        for (u32 y = 0; y < rect.h; ++y) {
+            u32 sy = std::min(static_cast<u32>(std::max(static_cast<i32>(y) - static_cast<i32>(padding), 0)), size_y - 1);
+            for (u32 x = 0; x < rect.w; ++x) {
+                u32 sx = std::min(static_cast<u32>(std::max(static_cast<i32>(x) - static_cast<i32>(padding), 0)), size_x - 1);
+                padded[size_t{y} * rect.w + x] = src[size_t{sy} * size_x + sx];
+            }
+        }
+        return padded;
+    }
+
+    // Uploads a padded block to level 0 of texture `id` at `rect` and
+    // builds every smaller level of it. A level L texel is the box average
+    // of the 2^L x 2^L level 0 texels under it. Blocks aren't aligned to
+    // 2^L, so texels on a block's border also cover a neighbour or empty
+    // space; those average only this block's texels, so an image never
+    // picks up its neighbour's colours. Whichever of the two blocks is
+    // uploaded last owns such a shared texel. The gutter keeps the image
+    // itself clear of them until 2^L exceeds `padding`.
+    void upload_block(u32 id, const std::vector<u32> &block, u32 layer, const PackRect &rect) const {
+        glTextureSubImage3D(id, 0, static_cast<GLint>(rect.x), static_cast<GLint>(rect.y), static_cast<GLint>(layer),
+                            static_cast<GLsizei>(rect.w), static_cast<GLsizei>(rect.h), 1, GL_RGBA, GL_UNSIGNED_BYTE, block.data());
+
+        // per-channel sums and how many level 0 texels went into them
+        struct Texel {
+            std::array<u64, 4> sum;
+            u64 n;
+        };
+        std::vector<Texel> prev, next;
+        std::vector<u32> level_data;
+        // the previous level's texels covering the block, in that level's
+        // coordinates
+        u32 x0 = rect.x, y0 = rect.y, w = rect.w, h = rect.h;
+        for (u32 level = 1; level < level_n; ++level) {
+            // GL rounds level sizes down, so with a size that isn't a power
+            // of two the last texel of a row also takes the odd one out
+            u32 last = std::max(size >> level, 1u) - 1;
+            auto down = [last](u32 coord) { return std::min(coord / 2, last); };
+            u32 next_x0 = down(x0), next_y0 = down(y0);
+            u32 next_w = down(x0 + w - 1) + 1 - next_x0, next_h = down(y0 + h - 1) + 1 - next_y0;
+            next.assign(size_t{next_w} * next_h, Texel{});
+            for (u32 y = 0; y < h; ++y) {
+                for (u32 x = 0; x < w; ++x) {
+                    auto &to = next[size_t{down(y0 + y) - next_y0} * next_w + (down(x0 + x) - next_x0)];
+                    size_t i = size_t{y} * w + x;
+                    if (level == 1) {
+                        for (u32 c = 0; c < 4; ++c)
+                            to.sum[c] += (block[i] >> (c * 8)) & 0xff;
+                        ++to.n;
+                    } else {
+                        for (u32 c = 0; c < 4; ++c)
+                            to.sum[c] += prev[i].sum[c];
+                        to.n += prev[i].n;
+                    }
+                }
+            }
+            level_data.resize(next.size());
+            for (size_t i = 0; i < next.size(); ++i) {
+                const auto &t = next[i];
+                u32 packed = 0;
+                for (u32 c = 0; c < 4; ++c)
+                    packed |= static_cast<u32>((t.sum[c] + t.n / 2) / t.n) << (c * 8);
+                level_data[i] = packed;
+            }
+            glTextureSubImage3D(id, static_cast<GLint>(level), static_cast<GLint>(next_x0), static_cast<GLint>(next_y0), static_cast<GLint>(layer),
+                                static_cast<GLsizei>(next_w), static_cast<GLsizei>(next_h), 1, GL_RGBA, GL_UNSIGNED_BYTE, level_data.data());
+            prev.swap(next);
+            x0 = next_x0, y0 = next_y0, w = next_w, h = next_h;
+        }
+    }
+
+    void update_stats() {
+        u64 total = u64{size} * size * layers.size();
+        stats.entry_n = static_cast<u32>(entries.size() - free_handles.size());
+        stats.layer_n = static_cast<u32>(layers.size());
+        stats.efficiency = total ? static_cast<f32>(static_cast<f64>(live_area) / static_cast<f64>(total)) : 0.0f;
+        stats.occupancy = total ? static_cast<f32>(static_cast<f64>(allocated_area()) / static_cast<f64>(total)) : 0.0f;
+    }
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include "model_cache.hpp"
+#include "texture_compress.hpp"
+#include "texture_mips.hpp"
+
+// Each executable defines STB_IMAGE_IMPLEMENTATION in its main.cpp.
+#include <stb_image.h>
+
+using texture_compress::BlockFormat;
+using texture_mips::MipFilter;
+
+// A full mip chain in one block format. Level data either lives in
+// `storage` (fresh build) or points into the mapped cache file.
+struct TextureData {
+    struct Level {
+        u32 size_x, size_y;
+        std::span<const u8> data;
+    };
+
+    BlockFormat format = BlockFormat::RGBA8;
+    bool srgb = false;
+    std::vector<Level> levels;
+    std::vector<u8> storage;
+    MappedFile file;
+
+    bool is_valid() const {
+        return !levels.empty();
+    }
+    u32 size_x() const {
+        return levels.empty() ? 0 : levels[0].size_x;
+    }
+    u32 size_y() const {
+        return levels.empty() ? 0 : levels[0].size_y;
+    }
+    size_t size_bytes() const {
+        size_t result = 0;
+        for (const auto &level : levels)
+            result += level.data.size();
+        return result;
+    }
+};
+
+// On-disk layout, loosely following KTX2: a fixed header, a level index,
+// then each level's data 16-byte aligned, largest level first.
+//
+//   TextureCacheHeader
+//   TextureCacheLevel[level_n]
+//   level data                  @ TextureCacheLevel::offset
+struct TextureCacheHeader {
+    static constexpr u32 MAGIC = 0x58455443; // "CTEX"
+    static constexpr u32 VERSION = 1;
+
+    u32 magic;
+    u32 version;
+    u32 format;
+    u32 srgb;
+    u32 mip_filter;
+    u32 level_n;
+    u64 path_hash;
+    i64 source_mtime;
+    u64 source_size;
+    u64 source_hash;
+};
+
+struct TextureCacheLevel {
+    u32 size_x, size_y;
+    u64 offset, size;
+};
+
+struct TextureCache {
+    static inline std::filesystem::path cache_dir = std::filesystem::temp_directory_path() / "coel_samples_texture_cache";
+
+    static std::filesystem::path cache_path(const std::filesystem::path &path, u64 path_hash, BlockFormat format) {
+        // one cache file per (source, format) pair
+        auto key = fnv1a_hash(std::span<const u8>(reinterpret_cast<const u8 *>(&format), sizeof(format)), path_hash);
+        auto name = path.stem().string() + "_";
+        for (i32 shift = 60; shift >= 0; shift -= 4)
+            name += "0123456789abcdef"[(key >> shift) & 0xf];
+        return cache_dir / (name + ".ctex");
+    }
+
+    static bool load(const std::filesystem::path &path, BlockFormat format, bool srgb, MipFilter mip_filter, TextureData &result) {
+        auto path_hash = ModelCache::canonical_path_hash(path);
+        auto file = MappedFile(cache_path(path, path_hash, format));
+        if (!file.is_valid() || file.size < sizeof(TextureCacheHeader))
+            return false;
+        const auto &header = *reinterpret_cast<const TextureCacheHeader *>(file.data);
+        if (header.magic != TextureCacheHeader::MAGIC || header.version != TextureCacheHeader::VERSION ||
+            header.format != static_cast<u32>(format) || header.srgb != static_cast<u32>(srgb) ||
+            header.mip_filter != static_cast<u32>(mip_filter) || header.path_hash != path_hash ||
+            sizeof(TextureCacheHeader) + header.level_n * sizeof(TextureCacheLevel) > file.size)
+            return false;
+
+        std::error_code ec;
+        auto source_size = std::filesystem::file_size(path, ec);
+        if (ec || header.source_size != source_size)
+            return false;
+        if (header.source_mtime != ModelCache::file_mtime(path) && header.source_hash != ModelCache::hash_file(path))
+            return false;
+
+        auto levels = std::span<const TextureCacheLevel>(reinterpret_cast<const TextureCacheLevel *>(file.data + sizeof(TextureCacheHeader)), header.level_n);
+        result.levels.clear();
+        for (const auto &level : levels) {
+            if (level.offset + level.size > file.size || level.size != texture_compress::level_size(format, level.size_x, level.size_y)) {
+                result.levels.clear();
+                return false;
+            }
+            result.levels.push_back({level.size_x, level.size_y, std::span<const u8>(file.data + level.offset, level.size)});
+        }
+        result.format = format;
+        result.srgb = srgb;
+        result.storage.clear();
+        result.file = std::move(file);
+        return result.is_valid();
+    }
+
+    static void store(const std::filesystem::path &path, MipFilter mip_filter, const TextureData &data) {
+        auto align16 = [](u64 x) { return (x + 15) & ~u64{15}; };
+        TextureCacheHeader header{
+            .magic = TextureCacheHeader::MAGIC,
+            .version = TextureCacheHeader::VERSION,
+            .format = static_cast<u32>(data.format),
+            .srgb = static_cast<u32>(data.srgb),
+            .mip_filter = static_cast<u32>(mip_filter),
+            .level_n = static_cast<u32>(data.levels.size()),
+            .path_hash = ModelCache::canonical_path_hash(path),
+            .source_mtime = ModelCache::file_mtime(path),
+            .source_size = 0,
+            .source_hash = ModelCache::hash_file(path),
+        };
+        std::error_code ec;
+        header.source_size = std::filesystem::file_size(path, ec);
+        if (ec)
+            return;
+        std::vector<TextureCacheLevel> levels;
+        u64 offset = align16(sizeof(TextureCacheHeader) + data.levels.size() * sizeof(TextureCacheLevel));
+        for (const auto &level : data.levels) {
+            levels.push_back({level.size_x, level.size_y, offset, level.data.size()});
+            offset = align16(offset + level.data.size());
+        }
+
+        std::filesystem::create_directories(cache_dir, ec);
+        auto final_path = cache_path(path, header.path_hash, data.format);
+        auto temp_path = final_path;
+        temp_path += ".tmp";
+        {
+            auto out = std::ofstream(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return;
+            auto write = [&](const void *ptr, u64 size) {
+                out.write(reinterpret_cast<const char *>(ptr), static_cast<std::streamsize>(size));
+            };
+            auto pad_to = [&](u64 target) {
+                const char zeros[16] = {};
+                write(zeros, target - static_cast<u64>(out.tellp()));
+            };
+            write(&header, sizeof(header));
+            write(levels.data(), levels.size() * sizeof(TextureCacheLevel));
+            for (size_t i = 0; i < levels.size(); ++i) {
+                pad_to(levels[i].offset);
+                write(data.levels[i].data.data(), data.levels[i].data.size());
+            }
+            if (!out)
+                return;
+        }
+        std::filesystem::rename(temp_path, final_path, ec);
+        if (ec)
+            std::filesystem::remove(temp_path, ec);
+    }
+
+    // Decodes the source image, builds the mip chain and encodes every
+    // level. Leaves `result` invalid and fills `error` on failure.
+    static void build(const std::filesystem::path &path, BlockFormat format, bool srgb, MipFilter mip_filter, TextureData &result, std::string &error) {
+        i32 size_x = 0, size_y = 0, channels = 0;
+        stbi_uc *pixels = stbi_load(path.string().c_str(), &size_x, &size_y, &channels, 4);
+        if (!pixels) {
+            error = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";
+            return;
+        }
+        auto source = std::span<const u8>(pixels, static_cast<size_t>(size_x) * static_cast<size_t>(size_y) * 4);
+        auto mips = texture_mips::build_mip_chain(source, static_cast<u32>(size_x), static_cast<u32>(size_y), srgb, mip_filter);
+        stbi_image_free(pixels);
+
+        std::vector<std::vector<u8>> encoded;
+        size_t total_size = 0;
+        for (const auto &mip : mips) {
+            encoded.push_back(texture_compress::compress_level(format, mip.rgba, mip.size_x, mip.size_y));
+            total_size += encoded.back().size();
+        }
+        result.format = format;
+        result.srgb = srgb;
+        result.file = {};
+        result.storage.clear();
+        result.storage.reserve(total_size);
+        for (const auto &level : encoded)
+            result.storage.insert(result.storage.end(), level.begin(), level.end());
+        result.levels.clear();
+        size_t offset = 0;
+        for (size_t i = 0; i < mips.size(); ++i) {
+            result.levels.push_back({mips[i].size_x, mips[i].size_y, std::span<const u8>(result.storage).subspan(offset, encoded[i].size())});
+            offset += encoded[i].size();
+        }
+        std::cout << path.filename().string() << ": " << size_x << "x" << size_y << ", " << mips.size() << " levels, "
+                  << (source.size() * 4 / 3) / 1024 << " KB -> " << total_size / 1024 << " KB\n";
+    }
+
+    // Level 0 only, as uncompressed RGBA8 and without going through the
+    // cache, for images that are uploaded somewhere other than their own
+    // texture.
+    static TextureData decode_rgba8(const std::filesystem::path &path, std::string &error) {
+        TextureData result;
+        i32 size_x = 0, size_y = 0, channels = 0;
+        stbi_uc *pixels = stbi_load(path.string().c_str(), &size_x, &size_y, &channels, 4);
+        if (!pixels) {
+            error = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";
+            return result;
+        }
+        result.storage.assign(pixels, pixels + static_cast<size_t>(size_x) * static_cast<size_t>(size_y) * 4);
+        stbi_image_free(pixels);
+        result.levels.push_back({static_cast<u32>(size_x), static_cast<u32>(size_y), std::span<const u8>(result.storage)});
+        return result;
+    }
+
+    static TextureData load_or_build(const std::filesystem::path &path, BlockFormat format, bool srgb, MipFilter mip_filter, std::string &error) {
+        TextureData result;
+        if (load(path, format, srgb, mip_filter, result))
+            return result;
+        build(path, format, srgb, mip_filter, result, error);
+        if (result.is_valid())
+            store(path, mip_filter, result);
+        return result;
+    }
+};
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include "parallel.hpp"
+
+// Block-compression encoders for RGBA8 mip levels. BC1/BC3 fit endpoints
+// along the principal axis of each 4x4 block and refine them once with a
+// least-squares solve; BC4/BC5 use the block's min/max. BC7 only emits
+// mode 6 (one subset, RGBA 7.7.7.7 + p-bit endpoints, 4-bit indices),
+// which is a valid BC7 stream and handles smooth colour well, though it
+// loses to a full mode search on blocks with several distinct colours.
+//
+// The matching decoders exist so the encoders can be checked on the CPU.
+namespace texture_compress {
+    enum class BlockFormat : u32 {
+        RGBA8 = 0,
+        BC1 = 1, // RGB, 4 bpp
+        BC3 = 2, // RGBA, 8 bpp
+        BC4 = 3, // R, 4 bpp
+        BC5 = 4, // RG, 8 bpp (normal maps)
+        BC7 = 5, // RGBA, 8 bpp
+    };
+
+    constexpr size_t block_size(BlockFormat format) {
+        switch (format) {
+        case BlockFormat::BC1:
+        case BlockFormat::BC4: return 8;
+        case BlockFormat::BC3:
+        case BlockFormat::BC5:
+        case BlockFormat::BC7: return 16;
+        default: return 0;
+        }
+    }
+
+    constexpr size_t level_size(BlockFormat format, u32 size_x, u32 size_y) {
+        if (format == BlockFormat::RGBA8)
+            return size_t{size_x} * size_y * 4;
+        return size_t{(size_x + 3) / 4} * ((size_y + 3) / 4) * block_size(format);
+    }
+
+    // 16 RGBA pixels of one 4x4 block, row-major
+    using Block = std::array<u8, 64>;
+
+    inline Block fetch_block(std::span<const u8> rgba, u32 size_x, u32 size_y, u32 bx, u32 by) {
+        Block result;
+        for (u32 y = 0; y < 4; ++y) {
+            for (u32 x = 0; x < 4; ++x) {
+                // edge blocks repeat the last row/column
+                size_t sx = std::min(bx * 4 + x, size_x - 1), sy = std::min(by * 4 + y, size_y - 1);
+                std::memcpy(result.data() + (y * 4 + x) * 4, rgba.data() + (sy * size_x + sx) * 4, 4);
+            }
+        }
+        return result;
+    }
+
+    // Principal axis of `n`-channel points by power iteration on the
+    // covariance matrix. Returns the mean too.
+    template <size_t N>
+    void principal_axis(const Block &block, std::array<f32, N> &mean, std::array<f32, N> &axis) {
+        mean.fill(0.0f);
+        for (size_t i = 0; i < 16; ++i)
+            for (size_t c = 0; c < N; ++c)
+                mean[c] += static_cast<f32>(block[i * 4 + c]) / 16.0f;
+        std::array<f32, N * N> cov{};
+        for (size_t i = 0; i < 16; ++i) {
+            std::array<f32, N> d;
+            for (size_t c = 0; c < N; ++c)
+                d[c] = static_cast<f32>(block[i * 4 + c]) - mean[c];
+            for (size_t r = 0; r < N; ++r)
+                for (size_t c = 0; c < N; ++c)
+                    cov[r * N + c] += d[r] * d[c];
+        }
+        axis.fill(1.0f);
+        for (i32 iter = 0; iter < 8; ++iter) {
+            std::array<f32, N> next{};
+            for (size_t r = 0; r < N; ++r)
+                for (size_t c = 0; c < N; ++c)
+                    next[r] += cov[r * N + c] * axis[c];
+            f32 len = 0.0f;
+            for (auto v : next)
+                len = std::max(len, std::abs(v));
+            if (len < 1e-8f)
+                break;
+            for (size_t c = 0; c < N; ++c)
+                axis[c] = next[c] / len;
+        }
+    }
+
+    inline u16 pack_565(f32 r, f32 g, f32 b) {
+        auto q = [](f32 v, f32 max) { return static_cast<u32>(std::clamp(std::round(v * max / 255.0f), 0.0f, max)); };
+        return static_cast<u16>((q(r, 31.0f) << 11) | (q(g, 63.0f) << 5) | q(b, 31.0f));
+    }
+    inline std::array<i32, 3> unpack_565(u16 c) {
+        i32 r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+    }
+
+    // Colour half of BC1/BC3. Always four-colour mode (c0 > c1), as BC3
+    // requires; a solid block ends up with c0 == c1 and all-zero indices.
+    inline void encode_bc1_color(const Block &block, u8 *out) {
+        auto palette_of = [](u16 c0, u16 c1) {
+            std::array<std::array<i32, 3>, 4> p;
+            p[0] = unpack_565(c0), p[1] = unpack_565(c1);
+            for (size_t c = 0; c < 3; ++c) {
+                p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+                p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+            }
+            return p;
+        };
+        auto fit = [&](u16 &c0, u16 &c1, std::array<u8, 16> &indices) {
+            if (c0 < c1)
+                std::swap(c0, c1);
+            auto p = palette_of(c0, c1);
+            i32 error = 0;
+            for (size_t i = 0; i < 16; ++i) {
+                i32 best = 0x7fffffff;
+                for (u8 k = 0; k < 4; ++k) {
+                    i32 d = 0;
+                    for (size_t c = 0; c < 3; ++c) {
+                        i32 e = block[i * 4 + c] - p[k][c];
+                        d += e * e;
+                    }
+                    if (d < best)
+                        best = d, indices[i] = k;
+                }
+                error += best;
+            }
+            if (c0 == c1)
+                indices.fill(0);
+            return error;
+        };
+
+        std::array<f32, 3> mean, axis;
+        principal_axis<3>(block, mean, axis);
+        f32 t_min = 0.0f, t_max = 0.0f;
+        f32 axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        for (size_t i = 0; i < 16 && axis_len2 > 0.0f; ++i) {
+            f32 t = 0.0f;
+            for (size_t c = 0; c < 3; ++c)
+                t += (static_cast<f32>(block[i * 4 + c]) - mean[c]) * axis[c];
+            t /= axis_len2;
+            t_min = std::min(t_min, t), t_max = std::max(t_max, t);
+        }
+        u16 c0 = pack_565(mean[0] + axis[0] * t_max, mean[1] + axis[1] * t_max, mean[2] + axis[2] * t_max);
+        u16 c1 = pack_565(mean[0] + axis[0] * t_min, mean[1] + axis[1] * t_min, mean[2] + axis[2] * t_min);
+        std::array<u8, 16> indices;
+        i32 error = fit(c0, c1, indices);
+
+        // Least-squares endpoints for the chosen indices (weights of c0 for
+        // index 0..3 are 1, 0, 2/3, 1/3), kept only if they help.
+        constexpr f32 WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        std::array<f32, 3> ax{}, bx{};
+        for (size_t i = 0; i < 16; ++i) {
+            f32 a = WEIGHTS[indices[i]], b = 1.0f - a;
+            aa += a * a, ab += a * b, bb += b * b;
+            for (size_t c = 0; c < 3; ++c) {
+                ax[c] += a * block[i * 4 + c];
+                bx[c] += b * block[i * 4 + c];
+            }
+        }
+        f32 det = aa * bb - ab * ab;
+        if (std::abs(det) > 1e-6f) {
+            std::array<f32, 3> e0, e1;
+            for (size_t c = 0; c < 3; ++c) {
+                e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+                e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+            }
+            u16 r0 = pack_565(e0[0], e0[1], e0[2]), r1 = pack_565(e1[0], e1[1], e1[2]);
+            std::array<u8, 16> refined_indices;
+            if (fit(r0, r1, refined_indices) < error)
+                c0 = r0, c1 = r1, indices = refined_indices;
+        }
+
+        u32 bits = 0;
+        for (size_t i = 0; i < 16; ++i)
+            bits |= u32{indices[i]} << (i * 2);
+        std::memcpy(out + 0, &c0, 2);
+        std::memcpy(out + 2, &c1, 2);
+        std::memcpy(out + 4, &bits, 4);
+    }
+
+    // One BC4 block from channel `channel` of `block`, eight-value mode.
+    inline void encode_bc4(const Block &block, size_t channel, u8 *out) {
+        u8 a0 = 0, a1 = 255;
+        for (size_t i = 0; i < 16; ++i) {
+            a0 = std::max(a0, block[i * 4 + channel]);
+            a1 = std::min(a1, block[i * 4 + channel]);
+        }
+        std::array<i32, 8> palette;
+        palette[0] = a0, palette[1] = a1;
+        for (i32 k = 2; k < 8; ++k)
+            palette[static_cast<size_t>(k)] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+        u64 bits = 0;
+        for (size_t i = 0; i < 16 && a0 != a1; ++i) {
+            i32 v = block[i * 4 + channel];
+            u64 best_k = 0;
+            i32 best = 0x7fffffff;
+            for (size_t k = 0; k < 8; ++k) {
+                i32 d = std::abs(v - palette[k]);
+                if (d < best)
+                    best = d, best_k = k;
+            }
+            bits |= best_k << (i * 3);
+        }
+        out[0] = a0, out[1] = a1;
+        for (size_t i = 0; i < 6; ++i)
+            out[2 + i] = static_cast<u8>(bits >> (i * 8));
+    }
+
+    inline constexpr std::array<i32, 16> BC7_WEIGHTS4 = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    struct Bc7Mode6Fit {
+        std::array<std::array<u32, 4>, 2> q;
+        std::array<u32, 2> p;
+        std::array<u32, 16> indices;
+        i32 error = 0;
+    };
+
+    // Quantises float endpoints to 7 bits plus the p-bit that lands
+    // closest, then picks the nearest palette entry per pixel.
+    inline Bc7Mode6Fit fit_bc7_mode6(const Block &block, const std::array<std::array<f32, 4>, 2> &endpoints) {
+        Bc7Mode6Fit result;
+        for (size_t e = 0; e < 2; ++e) {
+            f32 best_error = 1e30f;
+            for (u32 pbit = 0; pbit < 2; ++pbit) {
+                std::array<u32, 4> cand;
+                f32 error = 0.0f;
+                for (size_t c = 0; c < 4; ++c) {
+                    f32 v = std::clamp(endpoints[e][c], 0.0f, 255.0f);
+                    cand[c] = static_cast<u32>(std::clamp(std::round((v - static_cast<f32>(pbit)) / 2.0f), 0.0f, 127.0f));
+                    f32 d = static_cast<f32>((cand[c] << 1) | pbit) - v;
+                    error += d * d;
+                }
+                if (error < best_error)
+                    best_error = error, result.q[e] = cand, result.p[e] = pbit;
+            }
+        }
+        std::array<std::array<i32, 4>, 16> palette;
+        for (size_t k = 0; k < 16; ++k) {
+            for (size_t c = 0; c < 4; ++c) {
+                i32 e0 = static_cast<i32>((result.q[0][c] << 1) | result.p[0]), e1 = static_cast<i32>((result.q[1][c] << 1) | result.p[1]);
+                palette[k][c] = ((64 - BC7_WEIGHTS4[k]) * e0 + BC7_WEIGHTS4[k] * e1 + 32) >> 6;
+            }
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            i32 best = 0x7fffffff;
+            for (u32 k = 0; k < 16; ++k) {
+                i32 d = 0;
+                for (size_t c = 0; c < 4; ++c) {
+                    i32 e = block[i * 4 + c] - palette[k][c];
+                    d += e * e;
+                }
+                if (d < best)
+                    best = d, result.indices[i] = k;
+            }
+            result.error += best;
+        }
+        return result;
+    }
+
+    inline void encode_bc7_mode6(const Block &block, u8 *out) {
+        std::array<f32, 4> mean, axis;
+        principal_axis<4>(block, mean, axis);
+        f32 t_min = 0.0f, t_max = 0.0f;
+        f32 axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+        for (size_t i = 0; i < 16 && axis_len2 > 0.0f; ++i) {
+            f32 t = 0.0f;
+            for (size_t c = 0; c < 4; ++c)
+                t += (static_cast<f32>(block[i * 4 + c]) - mean[c]) * axis[c];
+            t /= axis_len2;
+            t_min = std::min(t_min, t), t_max = std::max(t_max, t);
+        }
+        std::array<std::array<f32, 4>, 2> endpoints;
+        for (size_t c = 0; c < 4; ++c) {
+            endpoints[0][c] = mean[c] + axis[c] * t_min;
+            endpoints[1][c] = mean[c] + axis[c] * t_max;
+        }
+        auto fit = fit_bc7_mode6(block, endpoints);
+
+        // a couple of least-squares refinements for the chosen indices
+        for (i32 iter = 0; iter < 2; ++iter) {
+            f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            std::array<f32, 4> ax{}, bx{};
+            for (size_t i = 0; i < 16; ++i) {
+                f32 b = static_cast<f32>(BC7_WEIGHTS4[fit.indices[i]]) / 64.0f, a = 1.0f - b;
+                aa += a * a, ab += a * b, bb += b * b;
+                for (size_t c = 0; c < 4; ++c) {
+                    ax[c] += a * block[i * 4 + c];
+                    bx[c] += b * block[i * 4 + c];
+                }
+            }
+            f32 det = aa * bb - ab * ab;
+            if (std::abs(det) < 1e-6f)
+                break;
+            for (size_t c = 0; c < 4; ++c) {
+                endpoints[0][c] = (ax[c] * bb - bx[c] * ab) / det;
+                endpoints[1][c] = (bx[c] * aa - ax[c] * ab) / det;
+            }
+            auto refined = fit_bc7_mode6(block, endpoints);
+            if (refined.error >= fit.error)
+                break;
+            fit = refined;
+        }
+        auto &q = fit.q;
+        auto &p = fit.p;
+        auto &indices = fit.indices;
+        // the anchor (pixel 0) index has an implicit zero MSB
+        if (indices[0] & 8) {
+            std::swap(q[0], q[1]);
+            std::swap(p[0], p[1]);
+            for (auto &i : indices)
+                i = 15 - i;
+        }
+
+        std::array<u64, 2> bits{};
+        u32 bit_pos = 0;
+        auto put = [&](u64 value, u32 n) {
+            for (u32 i = 0; i < n; ++i, ++bit_pos)
+                bits[bit_pos / 64] |= ((value >> i) & 1) << (bit_pos % 64);
+        };
+        put(1u << 6, 7);
+        for (size_t c = 0; c < 4; ++c) {
+            put(q[0][c], 7);
+            put(q[1][c], 7);
+        }
+        put(p[0], 1);
+        put(p[1], 1);
+        put(indices[0], 3);
+        for (size_t i = 1; i < 16; ++i)
+            put(indices[i], 4);
+        std::memcpy(out, bits.data(), 16);
+    }
+
+    inline void encode_block(BlockFormat format, const Block &block, u8 *out) {
+        switch (format) {
+        case BlockFormat::BC1: encode_bc1_color(block, out); break;
+        case BlockFormat::BC3:
+            encode_bc4(block, 3, out);
+            encode_bc1_color(block, out + 8);
+            break;
+        case BlockFormat::BC4: encode_bc4(block, 0, out); break;
+        case BlockFormat::BC5:
+            encode_bc4(block, 0, out);
+            encode_bc4(block, 1, out + 8);
+            break;
+        case BlockFormat::BC7: encode_bc7_mode6(block, out); break;
+        default: break;
+        }
+    }
+
+    // Encodes one RGBA8 level; block rows are spread over all threads.
+    inline std::vector<u8> compress_level(BlockFormat format, std::span<const u8> rgba, u32 size_x, u32 size_y) {
+        if (format == BlockFormat::RGBA8)
+            return std::vector<u8>(rgba.begin(), rgba.end());
+        u32 blocks_x = (size_x + 3) / 4, blocks_y = (size_y + 3) / 4;
+        std::vector<u8> result(level_size(format, size_x, size_y));
+        parallel_for(blocks_y, [&](size_t by) {
+            for (u32 bx = 0; bx < blocks_x; ++bx) {
+                auto block = fetch_block(rgba, size_x, size_y, bx, static_cast<u32>(by));
+                encode_block(format, block, result.data() + (by * blocks_x + bx) * block_size(format));
+            }
+        });
+        return result;
+    }
+
+    inline void decode_bc1_color(const u8 *in, Block &block, bool four_color_only) {
+        u16 c0, c1;
+        u32 bits;
+        std::memcpy(&c0, in + 0, 2);
+        std::memcpy(&c1, in + 2, 2);
+        std::memcpy(&bits, in + 4, 4);
+        std::array<std::array<i32, 4>, 4> p;
+        auto e0 = unpack_565(c0), e1 = unpack_565(c1);
+        for (size_t c = 0; c < 3; ++c) {
+            p[0][c] = e0[c], p[1][c] = e1[c];
+            if (c0 > c1 || four_color_only) {
+                p[2][c] = (2 * e0[c] + e1[c]) / 3;
+                p[3][c] = (e0[c] + 2 * e1[c]) / 3;
+            } else {
+                p[2][c] = (e0[c] + e1[c]) / 2;
+                p[3][c] = 0;
+            }
+        }
+        p[0][3] = p[1][3] = p[2][3] = 255;
+        p[3][3] = (c0 > c1 || four_color_only) ? 255 : 0;
+        for (size_t i = 0; i < 16; ++i)
+            for (size_t c = 0; c < 4; ++c)
+                block[i * 4 + c] = static_cast<u8>(p[(bits >> (i * 2)) & 3][c]);
+    }
+
+    inline void decode_bc4(const u8 *in, Block &block, size_t channel) {
+        i32 a0 = in[0], a1 = in[1];
+        std::array<i32, 8> palette;
+        palette[0] = a0, palette[1] = a1;
+        if (a0 > a1) {
+            for (i32 k = 2; k < 8; ++k)
+                palette[static_cast<size_t>(k)] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+        } else {
+            for (i32 k = 2; k < 6; ++k)
+                palette[static_cast<size_t>(k)] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+            palette[6] = 0, palette[7] = 255;
+        }
+        u64 bits = 0;
+        for (size_t i = 0; i < 6; ++i)
+            bits |= u64{in[2 + i]} << (i * 8);
+        for (size_t i = 0; i < 16; ++i)
+            block[i * 4 + channel] = static_cast<u8>(palette[(bits >> (i * 3)) & 7]);
+    }
+
+    // Mode 6 only; other modes decode to magenta.
+    inline void decode_bc7_mode6(const u8 *in, Block &block) {
+        std::array<u64, 2> bits;
+        std::memcpy(bits.data(), in, 16);
+        u32 bit_pos = 0;
+        auto get = [&](u32 n) {
+            u64 value = 0;
+            for (u32 i = 0; i < n; ++i, ++bit_pos)
+                value |= ((bits[bit_pos / 64] >> (bit_pos % 64)) & 1) << i;
+            return static_cast<u32>(value);
+        };
+        if (get(7) != (1u << 6)) {
+            for (size_t i = 0; i < 16; ++i)
+                block[i * 4 + 0] = 255, block[i * 4 + 1] = 0, block[i * 4 + 2] = 255, block[i * 4 + 3] = 255;
+            return;
+        }
+        std::array<std::array<u32, 4>, 2> q;
+        for (size_t c = 0; c < 4; ++c) {
+            q[0][c] = get(7);
+            q[1][c] = get(7);
+        }
+        u32 p0 = get(1), p1 = get(1);
+        for (size_t i = 0; i < 16; ++i) {
+            u32 k = get(i == 0 ? 3 : 4);
+            for (size_t c = 0; c < 4; ++c) {
+                i32 e0 = static_cast<i32>((q[0][c] << 1) | p0), e1 = static_cast<i32>((q[1][c] << 1) | p1);
+                block[i * 4 + c] = static_cast<u8>(((64 - BC7_WEIGHTS4[k]) * e0 + BC7_WEIGHTS4[k] * e1 + 32) >> 6);
+            }
+        }
+    }
+
+    // Back to RGBA8. Channels a format doesn't store come back as 0
+    // (colour) or 255 (alpha).
+    inline std::vector<u8> decompress_level(BlockFormat format, std::span<const u8> data, u32 size_x, u32 size_y) {
+        if (format == BlockFormat::RGBA8)
+            return std::vector<u8>(data.begin(), data.end());
+        std::vector<u8> result(size_t{size_x} * size_y * 4);
+        u32 blocks_x = (size_x + 3) / 4, blocks_y = (size_y + 3) / 4;
+        for (u32 by = 0; by < blocks_y; ++by) {
+            for (u32 bx = 0; bx < blocks_x; ++bx) {
+                const u8 *in = data.data() + (size_t{by} * blocks_x + bx) * block_size(format);
+                Block block;
+                for (size_t i = 0; i < 16; ++i)
+                    block[i * 4 + 0] = 0, block[i * 4 + 1] = 0, block[i * 4 + 2] = 0, block[i * 4 + 3] = 255;
+                switch (format) {
+                case BlockFormat::BC1: decode_bc1_color(in, block, false); break;
+                case BlockFormat::BC3:
+                    decode_bc1_color(in + 8, block, true);
+                    decode_bc4(in, block, 3);
+                    break;
+                case BlockFormat::BC4: decode_bc4(in, block, 0); break;
+                case BlockFormat::BC5:
+                    decode_bc4(in, block, 0);
+                    decode_bc4(in + 8, block, 1);
+                    break;
+                case BlockFormat::BC7: decode_bc7_mode6(in, block); break;
+                default: break;
+                }
+                for (u32 y = 0; y < 4; ++y) {
+                    for (u32 x = 0; x < 4; ++x) {
+                        u32 px = bx * 4 + x, py = by * 4 + y;
+                        if (px < size_x && py < size_y)
+                            std::memcpy(result.data() + (size_t{py} * size_x + px) * 4, block.data() + (y * 4 + x) * 4, 4);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+} // namespace texture_compress
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_MIPS_USE_SSE2 1
+#else
+#define TEXTURE_MIPS_USE_SSE2 0
+#endif
+
+// CPU mip chain generation for RGBA8 images. Filtering happens in linear
+// space: sRGB colour channels are decoded first and re-encoded after, so
+// mips don't darken. Alpha is always treated as linear.
+namespace texture_mips {
+    enum class MipFilter {
+        // 2x2 average; odd sizes use 3 weighted taps so no texel is dropped
+        Box,
+        // separable 6-tap Kaiser-windowed sinc, sharper with less aliasing
+        Kaiser,
+    };
+
+    struct MipLevel {
+        u32 size_x, size_y;
+        std::vector<u8> rgba;
+    };
+
+    inline f32 srgb_to_linear(f32 c) {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    inline f32 linear_to_srgb(f32 c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    inline const std::array<f32, 256> &srgb_to_linear_table() {
+        static const auto table = []() {
+            std::array<f32, 256> result;
+            for (size_t i = 0; i < 256; ++i)
+                result[i] = srgb_to_linear(static_cast<f32>(i) / 255.0f);
+            return result;
+        }();
+        return table;
+    }
+
+    // One RGBA pixel in registers.
+#if TEXTURE_MIPS_USE_SSE2
+    using Px = __m128;
+    inline Px px_load(const f32 *p) { return _mm_loadu_ps(p); }
+    inline void px_store(f32 *p, Px v) { _mm_storeu_ps(p, v); }
+    inline Px px_zero() { return _mm_setzero_ps(); }
+    inline Px px_add(Px a, Px b) { return _mm_add_ps(a, b); }
+    inline Px px_scale(Px a, f32 s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+#else
+    struct Px {
+        f32 v[4];
+    };
+    inline Px px_load(const f32 *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    inline void px_store(f32 *p, Px a) { p[0] = a.v[0], p[1] = a.v[1], p[2] = a.v[2], p[3] = a.v[3]; }
+    inline Px px_zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+    inline Px px_add(Px a, Px b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+    inline Px px_scale(Px a, f32 s) { return {{a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s}}; }
+#endif
+
+    // Source texels and weights for destination texel `d` along an axis of
+    // `s` texels reduced to `dn`. Even sizes average pairs. Odd sizes use a
+    // polyphase box: three taps whose weights slide with `d`, so each source
+    // texel contributes the same total and the level stays centred.
+    struct BoxTaps {
+        u32 first;
+        u32 n;
+        f32 weights[3];
+    };
+
+    inline BoxTaps box_taps(u32 d, u32 s, u32 dn) {
+        if (s == 1)
+            return {0, 1, {1.0f, 0.0f, 0.0f}};
+        if (s % 2 == 0)
+            return {2 * d, 2, {0.5f, 0.5f, 0.0f}};
+        auto inv_s = 1.0f / static_cast<f32>(s);
+        return {2 * d, 3, {static_cast<f32>(dn - d) * inv_s, static_cast<f32>(dn) * inv_s, static_cast<f32>(d + 1) * inv_s}};
+    }
+
+    inline void downsample_box(std::span<const f32> src, u32 sx, u32 sy, std::span<f32> dst, u32 dx, u32 dy) {
+        std::vector<BoxTaps> x_taps(dx);
+        for (u32 x = 0; x < dx; ++x)
+            x_taps[x] = box_taps(x, sx, dx);
+        for (u32 y = 0; y < dy; ++y) {
+            auto y_taps = box_taps(y, sy, dy);
+            f32 *out = dst.data() + size_t{y} * dx * 4;
+            for (u32 x = 0; x < dx; ++x) {
+                const auto &tx = x_taps[x];
+                auto acc = px_zero();
+                for (u32 j = 0; j < y_taps.n; ++j) {
+                    const f32 *row = src.data() + size_t{y_taps.first + j} * sx * 4;
+                    for (u32 i = 0; i < tx.n; ++i)
+                        acc = px_add(acc, px_scale(px_load(row + size_t{tx.first + i} * 4), tx.weights[i] * y_taps.weights[j]));
+                }
+                px_store(out + size_t{x} * 4, acc);
+            }
+        }
+    }
+
+    // Kaiser-windowed sinc for a 2x reduction, sampled at the six source
+    // pixel centres around each destination pixel and normalised.
+    inline std::array<f32, 6> kaiser_weights() {
+        constexpr f64 RADIUS = 3.0, BETA = 4.0;
+        auto bessel_i0 = [](f64 x) {
+            f64 sum = 1.0, term = 1.0;
+            for (i32 k = 1; k < 20; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+        std::array<f32, 6> result;
+        f64 total = 0.0;
+        for (size_t i = 0; i < 6; ++i) {
+            f64 d = static_cast<f64>(i) - 2.5;
+            f64 t = d / 2.0 * 3.14159265358979323846;
+            f64 sinc = std::sin(t) / t;
+            f64 r = d / RADIUS;
+            f64 window = bessel_i0(BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel_i0(BETA);
+            result[i] = static_cast<f32>(sinc * window);
+            total += result[i];
+        }
+        for (auto &w : result)
+            w = static_cast<f32>(w / total);
+        return result;
+    }
+
+    inline void downsample_kaiser(std::span<const f32> src, u32 sx, u32 sy, std::span<f32> dst, u32 dx, u32 dy) {
+        static const auto weights = kaiser_weights();
+        // horizontal pass into a dx * sy temporary, then vertical
+        std::vector<f32> temp(size_t{dx} * sy * 4);
+        for (u32 y = 0; y < sy; ++y) {
+            const f32 *row = src.data() + size_t{y} * sx * 4;
+            for (u32 x = 0; x < dx; ++x) {
+                auto acc = px_zero();
+                for (i32 k = 0; k < 6; ++k) {
+                    auto i = std::clamp(static_cast<i32>(2 * x) - 2 + k, 0, static_cast<i32>(sx) - 1);
+                    acc = px_add(acc, px_scale(px_load(row + static_cast<size_t>(i) * 4), weights[static_cast<size_t>(k)]));
+                }
+                px_store(temp.data() + (size_t{y} * dx + x) * 4, acc);
+            }
+        }
+        for (u32 y = 0; y < dy; ++y) {
+            for (u32 x = 0; x < dx; ++x) {
+                auto acc = px_zero();
+                for (i32 k = 0; k < 6; ++k) {
+                    auto j = std::clamp(static_cast<i32>(2 * y) - 2 + k, 0, static_cast<i32>(sy) - 1);
+                    acc = px_add(acc, px_scale(px_load(temp.data() + (static_cast<size_t>(j) * dx + x) * 4), weights[static_cast<size_t>(k)]));
+                }
+                px_store(dst.data() + (size_t{y} * dx + x) * 4, acc);
+            }
+        }
+    }
+
+    // Returns every level down to 1x1, starting with a copy of the input.
+    inline std::vector<MipLevel> build_mip_chain(std::span<const u8> rgba, u32 size_x, u32 size_y, bool srgb, MipFilter filter = MipFilter::Kaiser) {
+        std::vector<MipLevel> result;
+        result.push_back({size_x, size_y, std::vector<u8>(rgba.begin(), rgba.end())});
+
+        const auto &to_linear = srgb_to_linear_table();
+        std::vector<f32> src(size_t{size_x} * size_y * 4), dst;
+        for (size_t i = 0; i < src.size(); ++i)
+            src[i] = (srgb && (i & 3) != 3) ? to_linear[rgba[i]] : static_cast<f32>(rgba[i]) / 255.0f;
+
+        u32 sx = size_x, sy = size_y;
+        while (sx > 1 || sy > 1) {
+            u32 dx = std::max(sx / 2, 1u), dy = std::max(sy / 2, 1u);
+            dst.resize(size_t{dx} * dy * 4);
+            if (filter == MipFilter::Kaiser)
+                downsample_kaiser(src, sx, sy, dst, dx, dy);
+            else
+                downsample_box(src, sx, sy, dst, dx, dy);
+
+            auto &level = result.emplace_back(MipLevel{dx, dy, std::vector<u8>(dst.size())});
+            for (size_t i = 0; i < dst.size(); ++i) {
+                // the Kaiser lobes can overshoot
+                f32 c = std::clamp(dst[i], 0.0f, 1.0f);
+                if (srgb && (i & 3) != 3)
+                    c = linear_to_srgb(c);
+                level.rgba[i] = static_cast<u8>(c * 255.0f + 0.5f);
+            }
+            std::swap(src, dst);
+            sx = dx, sy = dy;
+        }
+        return result;
+    }
+} // namespace texture_mips
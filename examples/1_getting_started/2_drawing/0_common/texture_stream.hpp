@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "profiler.hpp"
+#include "texture_cache.hpp"
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+enum class TextureUsage {
+    // sRGB, white placeholder
+    Albedo,
+    // linear, flat +z placeholder
+    Normal,
+};
+
+// What a request turns into once decoded.
+enum class TextureTarget {
+    // block-compressed mip chain from the texture cache, in its own texture
+    Gpu,
+    // level 0 as RGBA8 in `StreamedTexture::pixels`, for the caller to upload
+    // (e.g. into a TextureAtlas); nothing is created on the GPU
+    Pixels,
+};
+
+// Albedo keeps colour and alpha in BC7; normals only need x and y (z is
+// rebuilt in the shader), which BC5 stores at full precision.
+inline BlockFormat texture_usage_format(TextureUsage usage) {
+    return usage == TextureUsage::Albedo ? BlockFormat::BC7 : BlockFormat::BC5;
+}
+
+inline GLenum gl_texture_format(BlockFormat format, bool srgb) {
+    switch (format) {
+    case BlockFormat::BC1: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case BlockFormat::BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BlockFormat::BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+// Allocates storage for every level of `data` with trilinear filtering.
+inline u32 create_gl_texture(const TextureData &data, GLenum wrap = GL_REPEAT) {
+    u32 id;
+    glCreateTextures(GL_TEXTURE_2D, 1, &id);
+    glTextureStorage2D(id, static_cast<GLsizei>(data.levels.size()), gl_texture_format(data.format, data.srgb),
+                       static_cast<GLsizei>(data.size_x()), static_cast<GLsizei>(data.size_y()));
+    glTextureParameteri(id, GL_TEXTURE_WRAP_S, static_cast<GLint>(wrap));
+    glTextureParameteri(id, GL_TEXTURE_WRAP_T, static_cast<GLint>(wrap));
+    glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(id, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(data.levels.size()) - 1);
+    return id;
+}
+
+// Uploads one level from `src`, which is either client memory or, with a
+// pixel unpack buffer bound, an offset into it.
+inline void upload_gl_texture_level(u32 id, const TextureData &data, size_t level_i, const void *src) {
+    const auto &level = data.levels[level_i];
+    auto level_gl = static_cast<GLint>(level_i);
+    auto sx = static_cast<GLsizei>(level.size_x), sy = static_cast<GLsizei>(level.size_y);
+    if (data.format == BlockFormat::RGBA8)
+        glTextureSubImage2D(id, level_gl, 0, 0, sx, sy, GL_RGBA, GL_UNSIGNED_BYTE, src);
+    else
+        glCompressedTextureSubImage2D(id, level_gl, 0, 0, sx, sy, gl_texture_format(data.format, data.srgb), static_cast<GLsizei>(level.data.size()), src);
+}
+
+// A texture that is decoded and uploaded in the background. Until it is
+// ready it binds a 1x1 placeholder, so it can be used right away.
+struct StreamedTexture {
+    std::filesystem::path path;
+    TextureUsage usage = TextureUsage::Albedo;
+    TextureTarget target = TextureTarget::Gpu;
+    u32 id = 0;
+    u32 fallback_id = 0;
+    i32 size_x = 0, size_y = 0;
+    bool ready = false;
+    bool failed = false;
+    // Pixels target only; the owner may release it once uploaded
+    std::vector<u8> pixels;
+
+    StreamedTexture() = default;
+    StreamedTexture(const StreamedTexture &) = delete;
+    StreamedTexture &operator=(const StreamedTexture &) = delete;
+
+    ~StreamedTexture() {
+        if (id) {
+            gl_state().forget_texture(id);
+            glDeleteTextures(1, &id);
+        }
+    }
+
+    u32 current_id() const {
+        return ready ? id : fallback_id;
+    }
+
+    void bind_slot(u32 slot) const {
+        gl_state().bind_texture_unit(slot, current_id());
+    }
+};
+
+// Loads block-compressed mip chains from the texture cache (building them
+// with stb_image, the mip generator and the block encoders on a miss) on a
+// pool of worker threads, and uploads them from the render thread through
+// a persistently mapped pixel unpack buffer. Loaded textures wait in a bounded staging queue (workers block
+// when it is full, which caps the memory held by texture data), and
+// `update` uploads at most `upload_budget` bytes per frame. The PBO is
+// split into FRAME_N regions guarded by fences, so a region is only
+// rewritten once the GPU has consumed it.
+//
+// `request` and `update` must be called from the thread that owns the GL
+// context.
+struct TextureStreamer {
+    static constexpr size_t FRAME_N = 3;
+
+    struct DecodedImage {
+        std::shared_ptr<StreamedTexture> texture;
+        TextureData data;
+        std::string error;
+    };
+
+    struct Stats {
+        u32 requested_n = 0;
+        u32 uploaded_n = 0;
+        u32 failed_n = 0;
+        // last `update` only
+        size_t frame_upload_bytes = 0;
+        u32 frame_upload_n = 0;
+        // GPU memory of everything uploaded so far
+        size_t resident_bytes = 0;
+    };
+
+    size_t upload_budget;
+    size_t staging_capacity;
+    MipFilter mip_filter = MipFilter::Kaiser;
+    Stats stats;
+
+    std::mutex mutex;
+    std::condition_variable decode_cv, staging_cv;
+    std::deque<std::shared_ptr<StreamedTexture>> decode_queue;
+    std::deque<DecodedImage> staging_queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    std::unordered_map<std::string, std::weak_ptr<StreamedTexture>> textures;
+    std::array<u32, 2> fallback_ids{};
+
+    u32 pbo_id = 0;
+    u8 *pbo_ptr = nullptr;
+    std::array<GLsync, FRAME_N> frame_fences{};
+    size_t frame_i = 0;
+
+    TextureStreamer(size_t upload_budget_ = size_t{8} << 20, size_t staging_capacity_ = 16, size_t worker_n = 0)
+        : upload_budget(upload_budget_), staging_capacity(std::max<size_t>(staging_capacity_, 1)) {
+        auto make_fallback = [](u32 rgba) {
+            u32 id;
+            glCreateTextures(GL_TEXTURE_2D, 1, &id);
+            glTextureStorage2D(id, 1, GL_RGBA8, 1, 1);
+            glTextureSubImage2D(id, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &rgba);
+            return id;
+        };
+        fallback_ids[static_cast<size_t>(TextureUsage::Albedo)] = make_fallback(0xffffffff);
+        fallback_ids[static_cast<size_t>(TextureUsage::Normal)] = make_fallback(0xffff8080);
+
+        glCreateBuffers(1, &pbo_id);
+        auto flags = static_cast<GLbitfield>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        auto pbo_size = static_cast<GLsizeiptr>(upload_budget * FRAME_N);
+        glNamedBufferStorage(pbo_id, pbo_size, nullptr, flags);
+        pbo_ptr = reinterpret_cast<u8 *>(glMapNamedBufferRange(pbo_id, 0, pbo_size, flags));
+
+        if (worker_n == 0)
+            worker_n = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (size_t i = 0; i < worker_n; ++i)
+            workers.emplace_back([this]() { decode_loop(); });
+    }
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    ~TextureStreamer() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        decode_cv.notify_all();
+        staging_cv.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+        staging_queue.clear();
+        for (auto fence : frame_fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        auto &state = gl_state();
+        state.forget_buffer(pbo_id);
+        for (auto id : fallback_ids)
+            state.forget_texture(id);
+        glUnmapNamedBuffer(pbo_id);
+        glDeleteBuffers(1, &pbo_id);
+        glDeleteTextures(static_cast<GLsizei>(fallback_ids.size()), fallback_ids.data());
+    }
+
+    // Never blocks. Requests for a path that is still alive share one
+    // texture.
+    std::shared_ptr<StreamedTexture> request(const std::filesystem::path &path, TextureUsage usage = TextureUsage::Albedo, TextureTarget target = TextureTarget::Gpu) {
+        auto key = path.generic_string() + (usage == TextureUsage::Albedo ? "#albedo" : "#normal") + (target == TextureTarget::Pixels ? "#pixels" : "");
+        auto &slot = textures[key];
+        if (auto existing = slot.lock())
+            return existing;
+        auto texture = std::make_shared<StreamedTexture>();
+        texture->path = path;
+        texture->usage = usage;
+        texture->target = target;
+        texture->fallback_id = fallback_ids[static_cast<size_t>(usage)];
+        slot = texture;
+        ++stats.requested_n;
+        {
+            std::lock_guard lock{mutex};
+            decode_queue.push_back(texture);
+        }
+        decode_cv.notify_one();
+        return texture;
+    }
+
+    // Call once per frame.
+    void update() {
+        PROFILE_SCOPE("texture_stream_update");
+        stats.frame_upload_bytes = 0;
+        stats.frame_upload_n = 0;
+        frame_i = (frame_i + 1) % FRAME_N;
+        auto &fence = frame_fences[frame_i];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        size_t region_offset = frame_i * upload_budget;
+        size_t used = 0;
+        bool used_pbo = false;
+        while (true) {
+            DecodedImage image;
+            {
+                std::lock_guard lock{mutex};
+                if (staging_queue.empty())
+                    break;
+                // an image larger than the whole budget still goes through,
+                // alone, so it cannot stall the queue
+                if (used > 0 && used + staging_queue.front().data.size_bytes() > upload_budget)
+                    break;
+                image = std::move(staging_queue.front());
+                staging_queue.pop_front();
+            }
+            staging_cv.notify_one();
+
+            auto &texture = *image.texture;
+            if (!image.data.is_valid()) {
+                texture.failed = true;
+                ++stats.failed_n;
+                std::cout << "ERROR::TEXTURE::" << texture.path.string() << ": " << image.error << std::endl;
+                continue;
+            }
+            if (texture.target == TextureTarget::Pixels) {
+                texture.size_x = static_cast<i32>(image.data.size_x());
+                texture.size_y = static_cast<i32>(image.data.size_y());
+                texture.pixels = std::move(image.data.storage);
+                texture.ready = true;
+                ++stats.uploaded_n;
+                continue;
+            }
+            texture.id = create_gl_texture(image.data);
+            auto size = image.data.size_bytes();
+            if (pbo_ptr && used + size <= upload_budget) {
+                gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo_id);
+                size_t offset = region_offset + used;
+                for (size_t i = 0; i < image.data.levels.size(); ++i) {
+                    const auto &level = image.data.levels[i];
+                    std::memcpy(pbo_ptr + offset, level.data.data(), level.data.size());
+                    upload_gl_texture_level(texture.id, image.data, i, reinterpret_cast<const void *>(offset));
+                    offset += level.data.size();
+                }
+                gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                used_pbo = true;
+            } else {
+                for (size_t i = 0; i < image.data.levels.size(); ++i)
+                    upload_gl_texture_level(texture.id, image.data, i, image.data.levels[i].data.data());
+            }
+            used += size;
+            texture.size_x = static_cast<i32>(image.data.size_x());
+            texture.size_y = static_cast<i32>(image.data.size_y());
+            texture.ready = true;
+            stats.resident_bytes += size;
+            ++stats.uploaded_n;
+            ++stats.frame_upload_n;
+        }
+        stats.frame_upload_bytes = used;
+        if (used_pbo)
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Textures that are neither uploaded nor failed yet.
+    size_t pending_n() const {
+        return stats.requested_n - stats.uploaded_n - stats.failed_n;
+    }
+
+  private:
+    void decode_loop() {
+        while (true) {
+            std::shared_ptr<StreamedTexture> texture;
+            {
+                std::unique_lock lock{mutex};
+                decode_cv.wait(lock, [this]() { return stopping || !decode_queue.empty(); });
+                if (stopping)
+                    return;
+                texture = std::move(decode_queue.front());
+                decode_queue.pop_front();
+            }
+            DecodedImage image;
+            image.texture = texture;
+            {
+                PROFILE_SCOPE("texture_decode");
+                if (texture->target == TextureTarget::Pixels)
+                    image.data = TextureCache::decode_rgba8(texture->path, image.error);
+                else
+                    image.data = TextureCache::load_or_build(texture->path, texture_usage_format(texture->usage), texture->usage == TextureUsage::Albedo, mip_filter, image.error);
+            }
+            {
+                std::unique_lock lock{mutex};
+                staging_cv.wait(lock, [this]() { return stopping || staging_queue.size() < staging_capacity; });
+                if (stopping)
+                    return;
+                staging_queue.push_back(std::move(image));
+            }
+        }
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+
+// Layout of a uniform or shader storage block as the linker laid it out.
+struct BlockLayout {
+    struct Member {
+        std::string name;
+        i32 offset;
+    };
+
+    std::string name;
+    u32 index = GL_INVALID_INDEX;
+    u32 size = 0;
+    i32 binding = -1;
+    std::vector<Member> members;
+
+    bool is_valid() const {
+        return index != GL_INVALID_INDEX;
+    }
+
+    // Member names are matched without any "Block." prefix. -1 if absent.
+    i32 offset_of(std::string_view member) const {
+        for (const auto &m : members) {
+            auto short_name = std::string_view(m.name).substr(m.name.rfind('.') == std::string::npos ? 0 : m.name.rfind('.') + 1);
+            if (m.name == member || short_name == member)
+                return m.offset;
+        }
+        return -1;
+    }
+};
+
+// `interface` is GL_UNIFORM_BLOCK or GL_SHADER_STORAGE_BLOCK.
+inline BlockLayout reflect_block(u32 program_id, GLenum interface, const char *name) {
+    BlockLayout result;
+    result.name = name;
+    result.index = glGetProgramResourceIndex(program_id, interface, name);
+    if (result.index == GL_INVALID_INDEX)
+        return result;
+    const GLenum block_props[] = {GL_BUFFER_DATA_SIZE, GL_BUFFER_BINDING, GL_NUM_ACTIVE_VARIABLES};
+    GLint block_values[3] = {};
+    glGetProgramResourceiv(program_id, interface, result.index, 3, block_props, 3, nullptr, block_values);
+    result.size = static_cast<u32>(block_values[0]);
+    result.binding = block_values[1];
+
+    std::vector<GLint> variables(static_cast<size_t>(block_values[2]));
+    const GLenum variables_prop = GL_ACTIVE_VARIABLES;
+    glGetProgramResourceiv(program_id, interface, result.index, 1, &variables_prop, static_cast<GLsizei>(variables.size()), nullptr, variables.data());
+    auto member_interface = interface == GL_UNIFORM_BLOCK ? GL_UNIFORM : GL_BUFFER_VARIABLE;
+    for (auto variable : variables) {
+        const GLenum member_props[] = {GL_NAME_LENGTH, GL_OFFSET};
+        GLint member_values[2] = {};
+        glGetProgramResourceiv(program_id, member_interface, static_cast<GLuint>(variable), 2, member_props, 2, nullptr, member_values);
+        std::string member_name(static_cast<size_t>(std::max(member_values[0], 1)), '\0');
+        glGetProgramResourceName(program_id, member_interface, static_cast<GLuint>(variable), member_values[0], nullptr, member_name.data());
+        member_name.pop_back();
+        result.members.push_back({std::move(member_name), member_values[1]});
+    }
+    return result;
+}
+
+struct BlockMember {
+    const char *name;
+    size_t offset;
+};
+
+// Checks once, at startup, that the C++ struct `T` matches the reflected
+// block: same size or larger, and every listed member at the same offset.
+template <typename T>
+bool check_block_layout(const BlockLayout &layout, std::initializer_list<BlockMember> members) {
+    if (!layout.is_valid()) {
+        std::cout << "ERROR::UNIFORM_BLOCK::" << layout.name << ": not found" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    if (sizeof(T) < layout.size) {
+        std::cout << "ERROR::UNIFORM_BLOCK::" << layout.name << ": struct is " << sizeof(T) << " bytes, block is " << layout.size << std::endl;
+        ok = false;
+    }
+    for (const auto &member : members) {
+        auto offset = layout.offset_of(member.name);
+        if (offset != static_cast<i32>(member.offset)) {
+            std::cout << "ERROR::UNIFORM_BLOCK::" << layout.name << "." << member.name << ": struct offset " << member.offset << ", block offset " << offset << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Per-frame and per-draw uniform data, written into one persistently
+// mapped buffer and bound by range. The buffer is split into FRAME_N
+// regions guarded by fences (like the texture streamer's PBO), so writing
+// a frame never waits on the GPU reading the previous ones, and a draw's
+// CPU cost is a memcpy plus glBindBufferRange. Allocations are aligned
+// for both UBO and SSBO binding.
+//
+//     ring.begin_frame();
+//     ring.push(frame_uniforms).bind(GL_UNIFORM_BUFFER, 0);
+//     for (...) { ring.push(draw_uniforms).bind(GL_UNIFORM_BUFFER, 1); draw(); }
+//     ring.end_frame();
+struct UniformRing {
+    static constexpr size_t FRAME_N = 3;
+
+    struct Allocation {
+        u32 buffer_id = 0;
+        size_t offset = 0, size = 0;
+        u8 *ptr = nullptr;
+
+        bool is_valid() const {
+            return ptr != nullptr;
+        }
+        void bind(GLenum target, u32 binding) const {
+            if (ptr)
+                gl_state().bind_buffer_range(target, binding, buffer_id, offset, size);
+        }
+    };
+
+    struct Stats {
+        // current frame
+        size_t used_bytes = 0;
+        u32 allocation_n = 0;
+        u32 overflow_n = 0;
+    };
+
+    size_t frame_capacity;
+    size_t alignment = 256;
+    u32 buffer_id = 0;
+    u8 *ptr = nullptr;
+    std::array<GLsync, FRAME_N> frame_fences{};
+    size_t frame_i = 0;
+    size_t head = 0;
+    Stats stats;
+
+    UniformRing(size_t frame_capacity_ = size_t{256} << 10) {
+        GLint ubo_alignment = 0, ssbo_alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+        alignment = static_cast<size_t>(std::max({ubo_alignment, ssbo_alignment, 16}));
+        frame_capacity = (frame_capacity_ + alignment - 1) / alignment * alignment;
+
+        glCreateBuffers(1, &buffer_id);
+        auto flags = static_cast<GLbitfield>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        auto size = static_cast<GLsizeiptr>(frame_capacity * FRAME_N);
+        glNamedBufferStorage(buffer_id, size, nullptr, flags);
+        ptr = reinterpret_cast<u8 *>(glMapNamedBufferRange(buffer_id, 0, size, flags));
+        head = frame_i * frame_capacity;
+    }
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    ~UniformRing() {
+        for (auto fence : frame_fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        gl_state().forget_buffer(buffer_id);
+        glUnmapNamedBuffer(buffer_id);
+        glDeleteBuffers(1, &buffer_id);
+    }
+
+    // Moves to the next region, waiting until the GPU is done with it.
+    void begin_frame() {
+        frame_i = (frame_i + 1) % FRAME_N;
+        auto &fence = frame_fences[frame_i];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        head = frame_i * frame_capacity;
+        stats = {};
+    }
+
+    // Call after the last draw that reads this frame's data.
+    void end_frame() {
+        auto &fence = frame_fences[frame_i];
+        if (fence)
+            glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Returns an invalid allocation (and counts an overflow) once the
+    // frame's region is full; binding that is a no-op.
+    Allocation alloc(size_t size) {
+        size_t region_end = (frame_i + 1) * frame_capacity;
+        if (!ptr || head + size > region_end) {
+            if (stats.overflow_n++ == 0)
+                std::cout << "ERROR::UNIFORM_RING::frame region of " << frame_capacity << " bytes is full" << std::endl;
+            return {};
+        }
+        Allocation result{buffer_id, head, size, ptr + head};
+        head = std::min((head + size + alignment - 1) / alignment * alignment, region_end);
+        stats.used_bytes = head - frame_i * frame_capacity;
+        ++stats.allocation_n;
+        return result;
+    }
+
+    template <typename T>
+    Allocation push(const T &value) {
+        auto result = alloc(sizeof(T));
+        if (result.ptr)
+            std::memcpy(result.ptr, &value, sizeof(T));
+        return result;
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <span>
+#include <vector>
+
+#include <cuiui/math/types.hpp>
+
+enum class VertexLayout {
+    // f32 pos, f32 nrm, f32 tex: 32 bytes, matches AssimpModelSource::Vertex
+    Float32,
+    // unorm16 pos (dequantised by the model matrix), snorm16 octahedral
+    // nrm, f16 tex: 16 bytes
+    Packed,
+};
+
+constexpr u16 f32_to_f16(f32 value) {
+    auto bits = std::bit_cast<u32>(value);
+    u32 sign = (bits >> 16) & 0x8000;
+    i32 exponent = static_cast<i32>((bits >> 23) & 0xff) - 127 + 15;
+    u32 mantissa = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff) // inf/nan
+        return static_cast<u16>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 0x1f) // overflow to inf
+        return static_cast<u16>(sign | 0x7c00);
+    if (exponent <= 0) { // subnormal or zero
+        if (exponent < -10)
+            return static_cast<u16>(sign);
+        mantissa |= 0x800000;
+        u32 shift = static_cast<u32>(14 - exponent);
+        u32 half_mantissa = mantissa >> shift;
+        u32 round_bit = 1u << (shift - 1);
+        if ((mantissa & round_bit) && ((mantissa & (3 * round_bit - 1)) || (half_mantissa & 1)))
+            ++half_mantissa;
+        return static_cast<u16>(sign | half_mantissa);
+    }
+    u32 half = sign | (static_cast<u32>(exponent) << 10) | (mantissa >> 13);
+    // round to nearest even; a carry into the exponent is still correct
+    if ((mantissa & 0x1000) && ((mantissa & 0x2fff) || (half & 1)))
+        ++half;
+    return static_cast<u16>(half);
+}
+
+constexpr f32 f16_to_f32(u16 value) {
+    u32 sign = static_cast<u32>(value & 0x8000) << 16;
+    u32 exponent = (value >> 10) & 0x1f;
+    u32 mantissa = value & 0x3ff;
+    if (exponent == 0) {
+        if (mantissa == 0)
+            return std::bit_cast<f32>(sign);
+        // renormalise the subnormal
+        exponent = 1;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        mantissa &= 0x3ff;
+        return std::bit_cast<f32>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+    }
+    if (exponent == 0x1f)
+        return std::bit_cast<f32>(sign | 0x7f800000 | (mantissa << 13));
+    return std::bit_cast<f32>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+inline i16 f32_to_snorm16(f32 value) {
+    return static_cast<i16>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+constexpr f32 snorm16_to_f32(i16 value) {
+    return std::max(static_cast<f32>(value) / 32767.0f, -1.0f);
+}
+
+// Octahedral normal encoding (Meyer et al. 2010): project onto the
+// octahedron |x|+|y|+|z| = 1 and fold the lower hemisphere over the
+// diagonals into the unit square.
+inline std::array<i16, 2> oct_encode(f32vec3 n) {
+    f32 l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+    if (l1 == 0.0f) // meshes without normals; decodes to +z
+        return {0, 0};
+    f32 inv_l1 = 1.0f / l1;
+    f32 x = n[0] * inv_l1, y = n[1] * inv_l1;
+    if (n[2] < 0.0f) {
+        f32 fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        f32 fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx, y = fy;
+    }
+    return {f32_to_snorm16(x), f32_to_snorm16(y)};
+}
+inline f32vec3 oct_decode(std::array<i16, 2> e) {
+    f32 x = snorm16_to_f32(e[0]), y = snorm16_to_f32(e[1]);
+    f32 z = 1.0f - std::abs(x) - std::abs(y);
+    if (z < 0.0f) {
+        f32 fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        f32 fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx, y = fy;
+    }
+    f32 inv_len = 1.0f / std::sqrt(x * x + y * y + z * z);
+    return {x * inv_len, y * inv_len, z * inv_len};
+}
+
+struct PackedVertex {
+    u16 pos[4]; // unorm16 xyz, w unused (keeps the next attribute aligned)
+    i16 nrm[2]; // snorm16 octahedral
+    u16 tex[2]; // f16
+};
+static_assert(sizeof(PackedVertex) == 16);
+
+struct PackedMesh {
+    std::vector<PackedVertex> vertices;
+    // pos = pos_offset + unorm_pos * pos_scale, per axis
+    f32vec3 pos_offset;
+    f32vec3 pos_scale;
+
+    // Column-major matrix that maps unorm positions back to model space;
+    // multiply it onto the right of the model matrix.
+    f32mat4 dequantize_mat() const {
+        auto result = f32mat4::identity();
+        auto *e = reinterpret_cast<f32 *>(&result);
+        e[0] = pos_scale[0], e[5] = pos_scale[1], e[10] = pos_scale[2];
+        e[12] = pos_offset[0], e[13] = pos_offset[1], e[14] = pos_offset[2];
+        return result;
+    }
+
+    f32vec3 decode_pos(const PackedVertex &v) const {
+        return {
+            pos_offset[0] + static_cast<f32>(v.pos[0]) / 65535.0f * pos_scale[0],
+            pos_offset[1] + static_cast<f32>(v.pos[1]) / 65535.0f * pos_scale[1],
+            pos_offset[2] + static_cast<f32>(v.pos[2]) / 65535.0f * pos_scale[2],
+        };
+    }
+    // Worst-case absolute position error per axis is half a quantisation step.
+    f32 max_pos_error(size_t axis) const {
+        return pos_scale[axis] / 65535.0f * 0.5f;
+    }
+};
+
+// Quantises positions against the mesh's own bounds, so precision scales
+// with mesh size rather than the whole scene.
+template <typename Vertex>
+PackedMesh pack_vertices(std::span<const Vertex> vertices) {
+    PackedMesh result{};
+    f32vec3 lo = {0.0f, 0.0f, 0.0f}, hi = {0.0f, 0.0f, 0.0f};
+    if (!vertices.empty()) {
+        lo = vertices[0].pos, hi = vertices[0].pos;
+        for (const auto &v : vertices) {
+            for (size_t k = 0; k < 3; ++k) {
+                lo[k] = std::min(lo[k], v.pos[k]);
+                hi[k] = std::max(hi[k], v.pos[k]);
+            }
+        }
+    }
+    for (size_t k = 0; k < 3; ++k) {
+        result.pos_offset[k] = lo[k];
+        result.pos_scale[k] = std::max(hi[k] - lo[k], 1e-20f);
+    }
+    result.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const auto &v = vertices[i];
+        auto &p = result.vertices[i];
+        for (size_t k = 0; k < 3; ++k) {
+            f32 t = (v.pos[k] - result.pos_offset[k]) / result.pos_scale[k];
+            p.pos[k] = static_cast<u16>(std::round(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+        }
+        p.pos[3] = 0;
+        auto nrm = oct_encode(v.nrm);
+        p.nrm[0] = nrm[0], p.nrm[1] = nrm[1];
+        p.tex[0] = f32_to_f16(v.tex[0]);
+        p.tex[1] = f32_to_f16(v.tex[1]);
+    }
+    return result;
+}
@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 #include <iostream>
 #include "../0_common.hpp"
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 namespace cuiui_default = cuiui::platform::defaults;
 int main() {
     cuiui_default::Context ui;
@@ -55,7 +56,9 @@ int main() {
         glDeleteShader(vert_shader_id);
         glDeleteShader(frag_shader_id);
     }
+    FrameStats frame_stats("simple_triangle_gl");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
@@ -3,6 +3,7 @@
 #include <coel/vulkan/core.hpp>
 #include <thread>
 #include "../0_common.hpp"
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 namespace cuiui_default = cuiui::platform::defaults;
 
 int main() {
@@ -48,7 +49,9 @@ int main() {
     volkInitialize();
     volkLoadInstance(vk_instance.handle);
     volkLoadDevice(vk_device.handle);
+    FrameStats frame_stats("simple_triangle_vk");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
@@ -3,16 +3,31 @@
 #include <array>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <span>
 #include <thread>
 
 #include <cuiui/math/types.hpp>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+struct StbiDeleter {
+    void operator()(stbi_uc *data) const {
+        stbi_image_free(data);
+    }
+};
+
+// Owns the buffer stb_image decoded into; `pixels` views it directly, so
+// nothing is copied between decoding and upload.
 struct Image {
-    std::vector<uint8_t> pixels;
-    int32_t size_x, size_y, channels;
+    std::unique_ptr<stbi_uc, StbiDeleter> data;
+    std::span<uint8_t> pixels;
+    int32_t size_x = 0, size_y = 0, channels = 0;
+
+    bool is_valid() const {
+        return data != nullptr;
+    }
 };
 
 struct Uniforms {
@@ -33,10 +48,7 @@ struct GameState {
     float prev_mouse_x = 0.0f, prev_mouse_y = 0.0f;
     bool paused = false;
 
-    std::chrono::high_resolution_clock::time_point prev_time = std::chrono::high_resolution_clock::now();
-    static constexpr auto FRAMETIMES_N = 20;
-    std::array<double, FRAMETIMES_N> last_n_frametimes{};
-    size_t frametimes_i = 0;
+    FrameStats frame_stats{"textured_quad"};
 
     void update(cuiui::WindowHandle<cuiui::platform::defaults::Window> &w) {
         while (!w->events.empty()) {
@@ -99,29 +111,23 @@ struct GameState {
         // if (rot_py)
         //     rot_y += 0.01f;
 
-        auto now = std::chrono::high_resolution_clock::now();
-        auto elapsed = std::chrono::duration<double>(now - prev_time).count();
-        prev_time = now;
-        last_n_frametimes[frametimes_i] = elapsed;
-        double last_n_frametimes_avg = 0.0;
-        for (auto t : last_n_frametimes)
-            last_n_frametimes_avg += t;
-        last_n_frametimes_avg *= 1.0 / FRAMETIMES_N;
-        frametimes_i++;
-        if (frametimes_i == FRAMETIMES_N)
-            frametimes_i = 0;
-        std::cout << "frame took " << elapsed * 1000 << "ms (avg: " << last_n_frametimes_avg << ", " << 1.0 / last_n_frametimes_avg << " FPS)\n";
+        frame_stats.tick();
     }
 };
 
-Image load_image(const char *const filepath) {
+// `desired_channels` of 0 keeps the channel count of the file.
+Image load_image(const char *const filepath, int32_t desired_channels = 0) {
     Image result;
     stbi_set_flip_vertically_on_load(false);
-    stbi_uc *data = stbi_load(filepath, &result.size_x, &result.size_y, &result.channels, 0);
-    result.pixels.resize(static_cast<size_t>(result.size_x * result.size_y * result.channels));
-    for (size_t i = 0; i < result.pixels.size(); ++i)
-        result.pixels[i] = data[i];
-    stbi_image_free(data);
+    result.data.reset(stbi_load(filepath, &result.size_x, &result.size_y, &result.channels, desired_channels));
+    if (!result.data) {
+        std::cout << "ERROR::IMAGE::" << filepath << ": " << (stbi_failure_reason() ? stbi_failure_reason() : "unknown error") << std::endl;
+        return result;
+    }
+    if (desired_channels != 0)
+        result.channels = desired_channels;
+    auto size = static_cast<size_t>(result.size_x) * static_cast<size_t>(result.size_y) * static_cast<size_t>(result.channels);
+    result.pixels = std::span<uint8_t>(result.data.get(), size);
     return result;
 }
 
@@ -209,6 +215,7 @@ Uniforms uniforms{
     .view = scale(f32mat4::identity(), {1.0f, 1.0f, 1.0f}),
 };
 
-Image image = load_image("examples/1_getting_started/2_drawing/2_textured_quad/0_common/test.png");
+// Decoded off the main thread by each backend, not during static init.
+constexpr const char *const test_image_path = "examples/1_getting_started/2_drawing/2_textured_quad/0_common/test.png";
 
 GameState game_state;
@@ -3,6 +3,10 @@
 #include <coel/opengl/core.hpp>
 #include <glad/glad.h>
 #include "../0_common/data.hpp"
+#include <1_getting_started/2_drawing/0_common/texture_stream.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 namespace cuiui_default = cuiui::platform::defaults;
 
 int main() {
@@ -20,6 +24,10 @@ int main() {
         gl_ctx.make_current();
         gladLoadGL();
     }
+    // Decodes on a worker while the rest is set up; the quad shows the
+    // streamer's white placeholder until the image arrives.
+    TextureStreamer streamer;
+    auto image = streamer.request(test_image_path, TextureUsage::Albedo, TextureTarget::Pixels);
     {
         gl_ctx.make_current();
         glCreateVertexArrays(1, &vao_id);
@@ -61,20 +69,6 @@ int main() {
         glDetachShader(shader_program_id, frag_shader_id);
         glDeleteShader(vert_shader_id);
         glDeleteShader(frag_shader_id);
-        int32_t internalformat = 0;
-        uint32_t format = 0;
-        uint32_t type = GL_UNSIGNED_BYTE;
-        switch (image.channels) {
-        case 3: internalformat = GL_RGB8, format = GL_RGB; break;
-        case 4: internalformat = GL_RGBA8, format = GL_RGBA; break;
-        }
-        glGenTextures(1, &tex_id);
-        glBindTexture(GL_TEXTURE_2D, tex_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalformat, image.size_x, image.size_y, 0, format, type, image.pixels.data());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
 
     while (true) {
@@ -82,6 +76,17 @@ int main() {
         if (w->should_close)
             break;
         gl_ctx.make_current();
+        streamer.update();
+        if (image && image->ready) {
+            glCreateTextures(GL_TEXTURE_2D, 1, &tex_id);
+            glTextureStorage2D(tex_id, 1, GL_RGBA8, image->size_x, image->size_y);
+            glTextureSubImage2D(tex_id, 0, 0, 0, image->size_x, image->size_y, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels.data());
+            glTextureParameteri(tex_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(tex_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(tex_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(tex_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            image = nullptr;
+        }
         game_state.update(w);
         auto &temp_uniforms = *reinterpret_cast<Uniforms*>(glMapNamedBuffer(ubo_id, GL_READ_WRITE));
         temp_uniforms = {
@@ -100,11 +105,12 @@ int main() {
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo_id);
         glBindVertexArray(vao_id);
         glActiveTexture(GL_TEXTURE0 + 1);
-        glBindTexture(GL_TEXTURE_2D, tex_id);
+        glBindTexture(GL_TEXTURE_2D, image ? image->current_id() : tex_id);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_id);
         glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
         gl_ctx.swap_buffers();
     }
+    glDeleteTextures(1, &tex_id);
     glDeleteProgram(shader_program_id);
     glDeleteBuffers(1, &vbo_id);
     glDeleteVertexArrays(1, &vao_id);
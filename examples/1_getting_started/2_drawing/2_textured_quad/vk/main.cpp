@@ -2,9 +2,15 @@
 #include <cuiui/platform/defaults.hpp>
 #include <coel/vulkan/core.hpp>
 #include "../0_common/data.hpp"
+#include <future>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 namespace cuiui_default = cuiui::platform::defaults;
 
 int main() {
+    // decode while the instance, device and swapchain are created
+    auto image_future = std::async(std::launch::async, []() { return load_image(test_image_path); });
     cuiui_default::Context ui;
     coel::vulkan::Instance vk_instance;
     coel::vulkan::PhysicalDevice vk_physical_device = coel::vulkan::choose_physical_device(vk_instance.handle);
@@ -22,11 +28,13 @@ int main() {
     coel::vulkan::Buffer vbo(vk_device.handle, vk_memory_properties, vertices.data(), sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
     coel::vulkan::Buffer ibo(vk_device.handle, vk_memory_properties, indices.data(), sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
     coel::vulkan::Buffer ubo(vk_device.handle, vk_memory_properties, &uniforms, sizeof(uniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    auto image = image_future.get();
     coel::vulkan::Image vk_image(vk_device.handle, vk_memory_properties, static_cast<uint32_t>(image.size_x), static_cast<uint32_t>(image.size_y));
     coel::vulkan::CommandPool vk_command_pool(vk_device.handle, vk_queue_family_index);
     auto vk_cmd = vk_command_pool.get_command_buffer();
     vk_cmd.begin();
-    vk_image.upload(vk_cmd.handle, image.pixels, static_cast<uint32_t>(image.channels));
+    // coel's upload takes a byte vector, so this backend keeps one copy
+    vk_image.upload(vk_cmd.handle, std::vector<uint8_t>(image.pixels.begin(), image.pixels.end()), static_cast<uint32_t>(image.channels));
     vk_cmd.end();
     vk_cmd.submit_blocking(vk_device.queues[0]);
 
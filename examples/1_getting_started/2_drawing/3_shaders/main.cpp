@@ -2,6 +2,10 @@
 
 #include <cuiui/cuiui.hpp>
 #include <cuiui/platform/defaults.hpp>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 namespace cuiui_default = cuiui::platform::defaults;
 
 int main() {
@@ -14,7 +18,9 @@ int main() {
     auto blit_pass = BlitWindowPass();
     auto scene = SpinningCubeScene();
 
+    FrameStats frame_stats("shaders");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
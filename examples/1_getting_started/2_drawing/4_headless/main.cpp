@@ -0,0 +1,185 @@
+// Renders every drawing scene for a fixed number of frames at a fixed
+// timestep, into an offscreen target rather than the window, then dumps
+// the last frame of each and compares it against a golden image.
+//
+//   headless [--frames N] [--scene NAME] [--out DIR] [--golden DIR]
+//            [--tolerance T] [--max-differing F] [--bless]
+//
+// --bless writes every golden from the current run; without it a missing
+// golden fails like a mismatch. The exit code is the number of scenes that
+// didn't match, or SKIP_EXIT_CODE when there is no GL 4.5 context to run on.
+// Frame times go to <out>/<scene>_frame_times.csv and _frame_stats.json.
+//
+// By default a cuiui window provides the context. For CI without a
+// display, configure with -DCOEL_SAMPLES_USE_EGL=ON to get a surfaceless
+// EGL context instead, and use Mesa's software rasteriser. The goldens were
+// rendered this way:
+//
+//   export LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe
+//   export MESA_GL_VERSION_OVERRIDE=4.6 MESA_GLSL_VERSION_OVERRIDE=460
+//   ./headless --bless
+//
+// Run it from the repository root so the scenes find examples/0_assets.
+
+#include "../0_common/scenes/all.hpp"
+#include "../0_common/frame_stats.hpp"
+#include "../0_common/headless.hpp"
+
+#include <cuiui/cuiui.hpp>
+#include <cuiui/platform/defaults.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+namespace cuiui_default = cuiui::platform::defaults;
+
+// ctest reports this as skipped rather than failed (SKIP_RETURN_CODE in
+// examples/CMakeLists.txt).
+constexpr int SKIP_EXIT_CODE = 77;
+
+struct HeadlessConfig {
+    u64 frames = 60;
+    f64 fixed_step = 1.0 / 60.0;
+    u32 size_x = 400, size_y = 400;
+    // empty runs every scene
+    std::string scene;
+    std::filesystem::path out_dir = "headless_out";
+    std::filesystem::path golden_dir = "examples/1_getting_started/2_drawing/4_headless/golden";
+    // per channel, out of 255
+    u32 tolerance = 8;
+    // fraction of pixels allowed to exceed the tolerance
+    f64 max_differing = 0.001;
+    bool bless = false;
+
+    static bool from_args(int argc, char **argv, HeadlessConfig &config) {
+        for (int i = 1; i < argc; ++i) {
+            auto arg = std::string_view(argv[i]);
+            auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+            const char *value = nullptr;
+            if (arg == "--bless") {
+                config.bless = true;
+            } else if (arg == "--frames" && (value = next())) {
+                config.frames = std::strtoull(value, nullptr, 10);
+            } else if (arg == "--scene" && (value = next())) {
+                config.scene = value;
+            } else if (arg == "--out" && (value = next())) {
+                config.out_dir = value;
+            } else if (arg == "--golden" && (value = next())) {
+                config.golden_dir = value;
+            } else if (arg == "--tolerance" && (value = next())) {
+                config.tolerance = static_cast<u32>(std::strtoul(value, nullptr, 10));
+            } else if (arg == "--max-differing" && (value = next())) {
+                config.max_differing = std::strtod(value, nullptr);
+            } else {
+                std::cout << "ERROR::HEADLESS::unknown or incomplete argument " << arg << std::endl;
+                return false;
+            }
+        }
+        return config.frames > 0;
+    }
+};
+
+// Scenes are constructed only once selected, so a run of one scene doesn't
+// pay for loading the others.
+template <typename Scene>
+bool run_scene(const char *name, const HeadlessConfig &config, RenderContext &renderer) {
+    if (!config.scene.empty() && config.scene != name)
+        return true;
+
+    auto target = OffscreenTarget(config.size_x, config.size_y);
+    auto pass = RenderPass();
+    pass.size = {config.size_x, config.size_y};
+    auto scene = std::make_unique<Scene>();
+    if constexpr (requires { scene->aspect; })
+        scene->aspect = static_cast<f32>(config.size_x) / static_cast<f32>(config.size_y);
+    if constexpr (requires { scene->viewport_height; })
+        scene->viewport_height = static_cast<f32>(config.size_y);
+    if constexpr (requires { scene->finish_loading(); })
+        scene->finish_loading();
+
+    scene_clock().set_fixed_step(config.fixed_step);
+    RgbImage image;
+    {
+        auto frame_stats = FrameStats((config.out_dir / name).string());
+        for (u64 frame_i = 0; frame_i < config.frames; ++frame_i) {
+            frame_stats.tick();
+            target.bind();
+            pass.begin();
+            scene->draw();
+            // the swap would otherwise be what waits for the GPU
+            if (frame_i + 1 == config.frames)
+                image = target.read();
+            else
+                glFinish();
+            renderer.end_frame();
+        }
+        frame_stats.tick();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    scene_clock().set_fixed_step(0.0);
+
+    auto out_path = config.out_dir / (std::string(name) + ".ppm");
+    auto golden_path = config.golden_dir / (std::string(name) + ".ppm");
+    write_ppm(out_path, image);
+    if (config.bless) {
+        write_ppm(golden_path, image);
+        std::cout << name << ": wrote golden " << golden_path.string() << "\n";
+        return true;
+    }
+    auto golden = read_ppm(golden_path);
+    if (!golden.is_valid()) {
+        std::cout << name << ": FAIL (no golden at " << golden_path.string() << ", run with --bless to create it)\n";
+        return false;
+    }
+    auto diff = compare_images(image, golden, config.tolerance);
+    bool passed = diff.size_matches && diff.differing_fraction <= config.max_differing;
+    std::cout << name << ": " << (passed ? "PASS" : "FAIL");
+    if (diff.size_matches)
+        std::cout << " (" << diff.differing_n << " pixels differ, max difference " << diff.max_difference << ")\n";
+    else
+        std::cout << " (size " << image.size_x << "x" << image.size_y << ", golden " << golden.size_x << "x" << golden.size_y << ")\n";
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    auto config = HeadlessConfig{};
+    if (!HeadlessConfig::from_args(argc, argv, config))
+        return -1;
+    std::error_code ec;
+    std::filesystem::create_directories(config.out_dir, ec);
+
+    RenderContext renderer;
+#if COEL_SAMPLES_USE_EGL
+    auto gl_context = SurfacelessGlContext();
+    if (!gl_context.is_valid())
+        return SKIP_EXIT_CODE;
+#else
+    // The window only provides the context; nothing is drawn to it.
+    cuiui_default::Context ui;
+    {
+        auto w = ui.window({.id = "w", .size = {config.size_x, config.size_y}});
+        renderer.attach_to(*w);
+    }
+#endif
+    // the scenes use 4.5 DSA throughout
+    GLint gl_major = 0, gl_minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+    if (gl_major * 10 + gl_minor < 45) {
+        std::cout << "headless: no GL 4.5 context (got " << gl_major << "." << gl_minor << "), skipping" << std::endl;
+        return SKIP_EXIT_CODE;
+    }
+
+    int failed_n = 0;
+    failed_n += !run_scene<TriangleScene>("triangle", config, renderer);
+    failed_n += !run_scene<SpinningCubeScene>("spinning_cube", config, renderer);
+    failed_n += !run_scene<InstancedCubesScene>("instanced_cubes", config, renderer);
+    failed_n += !run_scene<GonzaScene>("gonza", config, renderer);
+    return failed_n;
+}
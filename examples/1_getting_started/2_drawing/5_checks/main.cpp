@@ -0,0 +1,473 @@
+// Checks for the parts of 0_common, and of the cuiui sample's containers,
+// that run on the CPU alone (the GL state cache runs against
+// RecordingGlApi, the command queue against NullCommandBackend), so they
+// need no window or GL context. Each failure
+// is printed; the exit code is the number of failed checks. The command
+// queue's record/sort/submit timings are printed as well.
+
+#include "../0_common/command_list.hpp"
+#include "../0_common/gl_state.hpp"
+#include "../0_common/vertex_format.hpp"
+
+#include <misc/cuiui/id_index.hpp>
+#include <misc/cuiui/slot_map.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failed_n = 0;
+
+static void check(bool passed, const char *what, f64 value, f64 bound) {
+    if (passed)
+        return;
+    std::cout << "ERROR::CHECK::" << what << ": " << value << " exceeds " << bound << std::endl;
+    ++failed_n;
+}
+
+static void check_count(size_t count, size_t expected, const char *what) {
+    if (count == expected)
+        return;
+    std::cout << "ERROR::CHECK::" << what << ": " << count << ", expected " << expected << std::endl;
+    ++failed_n;
+}
+
+static void check_none(size_t n, const char *what) {
+    if (n == 0)
+        return;
+    std::cout << "ERROR::CHECK::" << what << ": " << n << std::endl;
+    ++failed_n;
+}
+
+// Half the distance to the next f16 at `value`'s magnitude, i.e. the most
+// that rounding to f16 may move it.
+static f32 f16_half_step(f32 value) {
+    auto magnitude = std::abs(value);
+    // below 2^-14 the spacing is that of the subnormals
+    if (magnitude < std::ldexp(1.0f, -14))
+        return std::ldexp(1.0f, -25);
+    return std::ldexp(1.0f, std::ilogb(magnitude) - 11);
+}
+
+static void check_f16() {
+    // every finite f16 survives f16 -> f32 -> f16 unchanged
+    u32 mismatch_n = 0;
+    for (u32 bits = 0; bits <= 0xffff; ++bits) {
+        auto half = static_cast<u16>(bits);
+        if ((half & 0x7c00) == 0x7c00)
+            continue;
+        mismatch_n += f32_to_f16(f16_to_f32(half)) != half;
+    }
+    check(mismatch_n == 0, "f16 round trip mismatches", mismatch_n, 0);
+}
+
+struct CheckVertex {
+    f32vec3 pos;
+    f32vec3 nrm;
+    f32vec2 tex;
+};
+
+static void check_packed_vertices() {
+    auto rng = std::mt19937(1234);
+    auto pos_dist = std::uniform_real_distribution<f32>(-37.0f, 52.0f);
+    auto nrm_dist = std::normal_distribution<f32>(0.0f, 1.0f);
+    auto tex_dist = std::uniform_real_distribution<f32>(-4.0f, 4.0f);
+
+    std::vector<CheckVertex> vertices(10000);
+    for (auto &v : vertices) {
+        v.pos = {pos_dist(rng), pos_dist(rng) * 0.01f, pos_dist(rng) * 3.0f};
+        f32vec3 n = {nrm_dist(rng), nrm_dist(rng), nrm_dist(rng)};
+        auto inv_len = 1.0f / std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        v.nrm = {n[0] * inv_len, n[1] * inv_len, n[2] * inv_len};
+        v.tex = {tex_dist(rng), tex_dist(rng) * 0.001f};
+    }
+    // the axis-aligned normals are where the octahedral fold has its seams
+    vertices[0].nrm = {0.0f, 0.0f, -1.0f};
+    vertices[1].nrm = {1.0f, 0.0f, 0.0f};
+    vertices[2].nrm = {0.0f, -1.0f, 0.0f};
+
+    auto packed = pack_vertices(std::span<const CheckVertex>(vertices));
+
+    // One snorm16 step in octahedral coordinates moves the point on the
+    // octahedron by at most 2 steps in l1 and normalising scales that by at
+    // most sqrt(3); rounding both coordinates costs at most one step.
+    constexpr f32 oct_step = 1.0f / 32767.0f;
+    const f32 nrm_bound = 2.0f * std::sqrt(3.0f) * oct_step;
+
+    f64 worst_pos = 0.0, worst_nrm = 0.0, worst_tex = 0.0;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const auto &v = vertices[i];
+        const auto &p = packed.vertices[i];
+
+        auto pos = packed.decode_pos(p);
+        for (size_t k = 0; k < 3; ++k) {
+            // plus a few f32 roundings in quantising and dequantising
+            auto slop = (std::abs(packed.pos_offset[k]) + packed.pos_scale[k]) * std::numeric_limits<f32>::epsilon() * 4.0f;
+            auto bound = packed.max_pos_error(k) + slop;
+            auto error = std::abs(pos[k] - v.pos[k]);
+            worst_pos = std::max(worst_pos, static_cast<f64>(error / bound));
+            check(error <= bound, "position error", error, bound);
+        }
+
+        auto nrm = oct_decode({p.nrm[0], p.nrm[1]});
+        auto dx = nrm[0] - v.nrm[0], dy = nrm[1] - v.nrm[1], dz = nrm[2] - v.nrm[2];
+        auto nrm_error = std::sqrt(dx * dx + dy * dy + dz * dz);
+        worst_nrm = std::max(worst_nrm, static_cast<f64>(nrm_error / nrm_bound));
+        check(nrm_error <= nrm_bound, "normal error", nrm_error, nrm_bound);
+
+        for (size_t k = 0; k < 2; ++k) {
+            auto bound = f16_half_step(v.tex[k]);
+            auto error = std::abs(f16_to_f32(p.tex[k]) - v.tex[k]);
+            worst_tex = std::max(worst_tex, static_cast<f64>(error / bound));
+            check(error <= bound, "uv error", error, bound);
+        }
+    }
+    std::cout << "vertex_format: worst error / bound: pos " << worst_pos << ", nrm " << worst_nrm << ", uv " << worst_tex << "\n";
+}
+
+static void check_gl_state() {
+    using Call = RecordingGlApi::Call;
+    BasicGlStateCache<RecordingGlApi> state;
+    const auto &api = state.api;
+
+    // redundant sets are filtered out
+    state.enable(GL_DEPTH_TEST);
+    state.enable(GL_DEPTH_TEST);
+    state.enable(GL_BLEND);
+    state.disable(GL_DEPTH_TEST);
+    state.disable(GL_DEPTH_TEST);
+    check_count(api.count(Call::Enable), 3, "enable/disable");
+
+    state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    check_count(api.count(Call::BlendFunc), 2, "blend_func");
+
+    state.use_program(3);
+    state.use_program(3);
+    state.bind_vertex_array(4);
+    state.bind_vertex_array(4);
+    state.bind_buffer(GL_ARRAY_BUFFER, 5);
+    state.bind_buffer(GL_ARRAY_BUFFER, 5);
+    state.bind_buffer_range(GL_UNIFORM_BUFFER, 0, 6);
+    state.bind_buffer_range(GL_UNIFORM_BUFFER, 0, 6);
+    state.bind_texture_unit(1, 7);
+    state.bind_texture_unit(1, 7);
+    check_count(api.count(Call::UseProgram), 1, "use_program");
+    check_count(api.count(Call::BindVertexArray), 1, "bind_vertex_array");
+    check_count(api.count(Call::BindBuffer), 1, "bind_buffer");
+    check_count(api.count(Call::BindBufferRange), 1, "bind_buffer_range");
+    check_count(api.count(Call::BindTextureUnit), 1, "bind_texture_unit");
+    check_count(state.stats.issued_n, api.calls.size(), "issued_n");
+    check_count(state.stats.filtered_n, 8, "filtered_n");
+
+    // a forgotten object may have been deleted and its name reused, so the
+    // next bind of that name must reach GL
+    state.forget_program(3);
+    state.use_program(3);
+    state.forget_vertex_array(4);
+    state.bind_vertex_array(4);
+    state.forget_buffer(5);
+    state.bind_buffer(GL_ARRAY_BUFFER, 5);
+    state.forget_buffer(6);
+    state.bind_buffer_range(GL_UNIFORM_BUFFER, 0, 6);
+    state.forget_texture(7);
+    state.bind_texture_unit(1, 7);
+    check_count(api.count(Call::UseProgram), 2, "use_program after forget_program");
+    check_count(api.count(Call::BindVertexArray), 2, "bind_vertex_array after forget_vertex_array");
+    check_count(api.count(Call::BindBuffer), 2, "bind_buffer after forget_buffer");
+    check_count(api.count(Call::BindBufferRange), 2, "bind_buffer_range after forget_buffer");
+    check_count(api.count(Call::BindTextureUnit), 2, "bind_texture_unit after forget_texture");
+
+    // forgetting another name leaves the binding cached
+    state.forget_texture(8);
+    state.bind_texture_unit(1, 7);
+    check_count(api.count(Call::BindTextureUnit), 2, "bind_texture_unit after forgetting another texture");
+
+    // after `invalidate` everything goes through once
+    state.invalidate();
+    state.enable(GL_BLEND);
+    state.blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    state.use_program(3);
+    check_count(api.count(Call::Enable), 4, "enable after invalidate");
+    check_count(api.count(Call::BlendFunc), 3, "blend_func after invalidate");
+    check_count(api.count(Call::UseProgram), 3, "use_program after invalidate");
+}
+
+// Random small ids, so that many packets share a key and stability and
+// state filtering both get exercised. `first` holds the item index, which
+// is record order.
+static DrawPacket random_packet(std::mt19937 &rng, u32 item_i) {
+    auto id = [&](u32 n) { return static_cast<u32>(rng() % n); };
+    auto shader = id(4) + 1, material = id(8) + 1;
+    auto depth = static_cast<f32>(id(16));
+    DrawPacket packet;
+    packet.key = id(2) ? SortKey::front_to_back(id(3), shader, material, depth) : SortKey::back_to_front(id(3), depth, shader, material);
+    packet.program_id = shader;
+    packet.vertex_array_id = id(2) + 1;
+    packet.texture_id = material;
+    packet.count = 3;
+    packet.first = item_i;
+    return packet;
+}
+
+// State changes a submit of `packets` in this order costs: one per change
+// of program, vertex array or texture.
+static size_t state_change_n(const std::vector<const DrawPacket *> &packets) {
+    size_t n = 0;
+    const DrawPacket *prev = nullptr;
+    for (const auto *p : packets) {
+        n += !prev || p->program_id != prev->program_id;
+        n += !prev || p->vertex_array_id != prev->vertex_array_id;
+        n += !prev || p->texture_id != prev->texture_id;
+        prev = p;
+    }
+    return n;
+}
+
+static void check_command_queue() {
+    constexpr u32 ITEM_N = 5000;
+    auto rng = std::mt19937(42);
+    std::vector<DrawPacket> items(ITEM_N);
+    for (u32 i = 0; i < ITEM_N; ++i)
+        items[i] = random_packet(rng, i);
+
+    // small chunks so recording goes through many lists and threads
+    CommandQueue queue;
+    queue.record(ITEM_N, [&](CommandList &list, size_t i) { list.push(items[i]); }, 64);
+    queue.sort();
+    check_count(queue.entries.size(), ITEM_N, "sorted packet count");
+
+    std::vector<const DrawPacket *> sorted;
+    std::vector<bool> seen(ITEM_N);
+    size_t out_of_order_n = 0, unstable_n = 0, duplicate_n = 0;
+    for (const auto &entry : queue.entries) {
+        const auto &packet = queue.lists[entry.list_i].packets[entry.packet_i];
+        if (!sorted.empty()) {
+            const auto &prev = *sorted.back();
+            out_of_order_n += packet.key < prev.key;
+            unstable_n += packet.key == prev.key && packet.first < prev.first;
+        }
+        duplicate_n += seen[packet.first];
+        seen[packet.first] = true;
+        sorted.push_back(&packet);
+    }
+    check_none(out_of_order_n, "command keys out of order");
+    check_none(unstable_n, "equal command keys out of record order");
+    check_none(duplicate_n, "commands sorted twice");
+
+    NullCommandBackend backend;
+    queue.submit(backend);
+    check_count(backend.draw_n, ITEM_N, "null backend draws");
+    check_count(backend.state().stats.issued_n, state_change_n(sorted), "state changes after sort");
+    // sorting by key has to beat record order, or there is no point to it
+    std::vector<const DrawPacket *> recorded;
+    for (const auto &item : items)
+        recorded.push_back(&item);
+    if (backend.state().stats.issued_n >= state_change_n(recorded)) {
+        std::cout << "ERROR::CHECK::sorted submit issues " << backend.state().stats.issued_n << " state changes, record order "
+                  << state_change_n(recorded) << std::endl;
+        ++failed_n;
+    }
+
+    // keys that differ only in their top byte, and keys that are all equal,
+    // where every pass but one (or all of them) is skipped
+    std::vector<CommandQueue::Entry> entries, temp;
+    for (u32 i = 0; i < 1000; ++i)
+        entries.push_back({u64{rng() % 256} << 56, 0, i});
+    CommandQueue::radix_sort(entries, temp);
+    out_of_order_n = unstable_n = 0;
+    for (size_t i = 1; i < entries.size(); ++i) {
+        out_of_order_n += entries[i].key < entries[i - 1].key;
+        unstable_n += entries[i].key == entries[i - 1].key && entries[i].packet_i < entries[i - 1].packet_i;
+    }
+    check_none(out_of_order_n, "top-byte keys out of order");
+    check_none(unstable_n, "equal top-byte keys out of order");
+    for (u32 i = 0; i < entries.size(); ++i)
+        entries[i] = {7, 0, i};
+    CommandQueue::radix_sort(entries, temp);
+    unstable_n = 0;
+    for (u32 i = 0; i < entries.size(); ++i)
+        unstable_n += entries[i].packet_i != i;
+    check_none(unstable_n, "equal keys reordered");
+}
+
+// Record, sort and submit to the null backend for a frame's worth of
+// packets, best of a few runs.
+static void bench_command_queue() {
+    constexpr u32 ITEM_N = 100000;
+    constexpr u32 RUN_N = 10;
+    auto rng = std::mt19937(7);
+    std::vector<DrawPacket> items(ITEM_N);
+    for (u32 i = 0; i < ITEM_N; ++i)
+        items[i] = random_packet(rng, i);
+
+    CommandQueue queue;
+    CommandQueue::Stats best;
+    best.record_ms = best.sort_ms = best.submit_ms = std::numeric_limits<f64>::max();
+    for (u32 run_i = 0; run_i < RUN_N; ++run_i) {
+        NullCommandBackend backend;
+        queue.clear();
+        queue.record(ITEM_N, [&](CommandList &list, size_t i) { list.push(items[i]); });
+        queue.sort();
+        queue.submit(backend);
+        best.record_ms = std::min(best.record_ms, queue.stats.record_ms);
+        best.sort_ms = std::min(best.sort_ms, queue.stats.sort_ms);
+        best.submit_ms = std::min(best.submit_ms, queue.stats.submit_ms);
+        best.list_n = queue.stats.list_n;
+    }
+    std::cout << "command_list: " << ITEM_N << " packets in " << best.list_n << " lists: record " << best.record_ms << " ms, sort "
+              << best.sort_ms << " ms, submit " << best.submit_ms << " ms\n";
+}
+
+static void check_slot_map() {
+    // small pages, so a few values already need several
+    using Map = cuiui::SlotMap<u32, 4>;
+    Map map;
+    std::vector<Map::Handle> handles;
+    for (u32 i = 0; i < 10; ++i)
+        handles.push_back(map.emplace(i * 10));
+    check_count(map.size, 10, "slot map size after emplace");
+    check_count(map.pages.size(), 3, "slot map pages");
+    size_t wrong_n = 0;
+    for (u32 i = 0; i < 10; ++i) {
+        const auto *value = map.get(handles[i]);
+        wrong_n += !value || *value != i * 10 || handles[i].index != i;
+    }
+    check_none(wrong_n, "slot map values wrong after emplace");
+
+    // values don't move when later pages are added
+    const auto *first = map.get(handles[0]);
+    for (u32 i = 0; i < 20; ++i)
+        map.emplace(0u);
+    check_none(map.get(handles[0]) != first, "slot map value moved when the map grew");
+    for (u32 i = 10; i < 30; ++i)
+        map.erase(i);
+
+    map.erase(handles[3].index);
+    map.erase(handles[6].index);
+    // erasing twice is a no-op
+    map.erase(handles[6].index);
+    check_count(map.size, 8, "slot map size after erase");
+    check_none(map.contains(handles[3]) || map.get(handles[6]) != nullptr, "slot map erased value still found");
+
+    // the free list hands back the last erased slot first, with a new
+    // generation, so handles to the old value no longer match
+    auto reused = map.emplace(99u);
+    check_count(reused.index, handles[6].index, "slot map reused index");
+    check_none(reused.generation == handles[6].generation, "slot map generation not bumped");
+    check_none(map.get(handles[6]) != nullptr, "stale slot map handle found the new value");
+    check_none(!map.get(reused) || *map.get(reused) != 99, "slot map reinserted value");
+    check_none(map.contains({map.slot_n + 5, 0}) || map.contains(Map::Handle{}), "slot map handle past the end found");
+
+    // iteration skips erased slots, goes in slot order, and may erase the
+    // value it is given
+    std::vector<u32> visited;
+    map.for_each([&](u32 index, u32 &value) {
+        visited.push_back(index);
+        if (value == 20)
+            map.erase(index);
+    });
+    auto expected = std::vector<u32>{0, 1, 2, 4, 5, 6, 7, 8, 9};
+    check_none(visited != expected, "slot map iteration order");
+    check_none(map.contains(handles[2]), "slot map value erased during iteration");
+    check_count(map.size, 8, "slot map size after erasing during iteration");
+}
+
+// Hashes are chosen by hand so keys collide: with the minimum 64 slots,
+// hash h lands on slot h % 64.
+static void check_id_index() {
+    struct Key {
+        std::string id;
+        size_t hash;
+    };
+    // A run from slot 10: a0 a1 a2 at 10-12, d at its own home 13, then
+    // a3 a4 (homed at 10) and b, c (homed at 11, 12) behind it. Erasing
+    // from the front of the run must shift the a's, b and c back but
+    // leave d where it is.
+    std::vector<Key> keys;
+    for (size_t k = 0; k < 3; ++k)
+        keys.push_back({"a" + std::to_string(k), 10 + 64 * k});
+    keys.push_back({"d", 13 + 128});
+    for (size_t k = 3; k < 5; ++k)
+        keys.push_back({"a" + std::to_string(k), 10 + 64 * k});
+    keys.push_back({"b", 11});
+    keys.push_back({"c", 12 + 64});
+    // a cluster that wraps from slot 62 around to slot 1
+    for (size_t k = 0; k < 4; ++k)
+        keys.push_back({"w" + std::to_string(k), 62 + 64 * k});
+
+    cuiui::IdIndex index;
+    for (size_t i = 0; i < keys.size(); ++i)
+        index.insert(keys[i].hash, static_cast<u32>(i));
+    check_count(index.slots.size(), cuiui::IdIndex::MIN_CAPACITY, "id index capacity");
+
+    auto id_of = [&](u32 i) -> std::string_view { return keys[i].id; };
+    std::vector<bool> erased(keys.size());
+    auto wrong_lookups = [&]() {
+        size_t n = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto found = index.find(keys[i].id, keys[i].hash, id_of);
+            n += found != (erased[i] ? cuiui::IdIndex::EMPTY : static_cast<u32>(i));
+        }
+        return n;
+    };
+    check_none(wrong_lookups(), "id index lookups after insert");
+
+    // the middle of each cluster, then its first entry, then a key that
+    // probed past the cluster
+    for (auto i : {1, 0, 6, 9, 8}) {
+        index.erase(keys[static_cast<size_t>(i)].hash, static_cast<u32>(i));
+        erased[static_cast<size_t>(i)] = true;
+        check_none(wrong_lookups(), "id index lookups after erase");
+    }
+    check_count(index.size, keys.size() - 5, "id index size after erase");
+
+    // erasing something that isn't there changes nothing
+    index.erase(keys[1].hash, 1);
+    index.erase(30, 0);
+    check_count(index.size, keys.size() - 5, "id index size after erasing a missing key");
+    check_none(wrong_lookups(), "id index lookups after erasing a missing key");
+
+    // reinserted keys are found again, wherever they now land
+    for (auto i : {0, 9}) {
+        index.insert(keys[static_cast<size_t>(i)].hash, static_cast<u32>(i));
+        erased[static_cast<size_t>(i)] = false;
+    }
+    check_none(wrong_lookups(), "id index lookups after reinsert");
+
+    // many keys on few home slots, erased at random, across growth
+    auto rng = std::mt19937(3);
+    keys.clear();
+    erased.clear();
+    index = {};
+    for (size_t i = 0; i < 2000; ++i) {
+        keys.push_back({"k" + std::to_string(i), (rng() % 32) * 4099});
+        index.insert(keys.back().hash, static_cast<u32>(i));
+        erased.push_back(false);
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (rng() % 2 == 0) {
+            index.erase(keys[i].hash, static_cast<u32>(i));
+            erased[i] = true;
+        }
+    }
+    check_none(wrong_lookups(), "id index lookups after random erases");
+    check_count(index.size, static_cast<size_t>(std::count(erased.begin(), erased.end(), false)), "id index size after random erases");
+}
+
+int main() {
+    check_f16();
+    check_packed_vertices();
+    check_gl_state();
+    check_command_queue();
+    bench_command_queue();
+    check_slot_map();
+    check_id_index();
+    std::cout << (failed_n == 0 ? "all checks passed" : "checks failed") << "\n";
+    return failed_n;
+}
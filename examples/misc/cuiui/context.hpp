@@ -1,13 +1,19 @@
 #pragma once
 
+#include <cassert>
 #include <ranges>
 #include <algorithm>
+#include <array>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include <string_view>
 
 #include <iostream>
 
 #include "events.hpp"
+#include "id_index.hpp"
+#include "slot_map.hpp"
 #include "render_element.hpp"
 
 #include "ui/button.hpp"
@@ -24,21 +30,29 @@ namespace cuiui {
         typename T::Config init;
     };
 
-    template <typename... BaseTypes>
+    template <typename T>
     struct Component {
         std::string_view id;
-        std::variant<BaseTypes...> base;
-        bool is_stale;
+        size_t id_hash;
+        T base;
+        bool is_stale = true;
+
+        Component(std::string_view id_, size_t id_hash_, size_t depth, const typename T::Config &init)
+            : id(id_), id_hash(id_hash_), base(depth, init) {}
     };
 
+    // Slot index and generation in the component's type pool. Handles stay
+    // valid until their component goes stale and is removed.
     template <typename T>
     struct ComponentHandle {
-        size_t i;
+        u32 i;
+        u32 generation;
     };
 
     template <>
     struct ComponentHandle<Window> {
-        size_t i;
+        u32 i;
+        u32 generation;
         size_t *depth;
         ~ComponentHandle() {
             --depth;
@@ -60,12 +74,26 @@ namespace cuiui {
 
     template <typename... Components>
     struct BasicContext {
-        using ComponentType = Component<Components...>;
+        static constexpr u32 TYPE_N = sizeof...(Components);
+
+        // Where a component submitted this frame lives: its type's pool
+        // and the slot in it.
+        struct ComponentRef {
+            u32 type;
+            u32 i;
+        };
 
         std::vector<Event> events;
         std::vector<RenderElement> render_elements;
-        std::vector<ComponentType> components;
-        std::vector<size_t> component_indices;
+        // One pool per component type, so each is as large as its own type
+        // and not the largest one. Slots never move, so a Window's address
+        // stays registered with GLFW, and stale ones are removed without
+        // shifting the rest. Ids are unique per type.
+        std::tuple<SlotMap<Component<Components>>...> pools;
+        std::array<IdIndex, TYPE_N> component_ids;
+        // in submission order, which sets draw order (and, reversed, which
+        // component sees input first)
+        std::vector<ComponentRef> component_indices;
 
         UiColors colors;
         f32vec2 mouse_pos;
@@ -77,55 +105,72 @@ namespace cuiui {
             pt[1] += pt_margin[1];
         }
 
+        template <typename T>
+        static constexpr u32 type_index() {
+            constexpr bool matches[] = {std::same_as<T, Components>...};
+            for (u32 i = 0; i < TYPE_N; ++i) {
+                if (matches[i])
+                    return i;
+            }
+            return TYPE_N;
+        }
+
+        template <typename T>
+        SlotMap<Component<T>> &pool() {
+            return std::get<SlotMap<Component<T>>>(pools);
+        }
+        template <typename T>
+        const SlotMap<Component<T>> &pool() const {
+            return std::get<SlotMap<Component<T>>>(pools);
+        }
+
         void new_frame() {
             component_indices.clear();
             render_elements.clear();
             events.clear();
             pt = f32vec2{0.0f, 0.0f} + pt_margin;
             depth = 0;
-            for (auto &c : components)
-                c.is_stale = true;
+            (pool<Components>().for_each([](u32, auto &c) { c.is_stale = true; }), ...);
         }
 
         template <typename T>
         ComponentHandle<T> submit(const ComponentConfig<T> &config) {
-            auto find_component = std::ranges::find_if(components, [&](const auto &c) { return c.id == config.id; });
-            size_t component_i;
-            if (find_component != components.end()) {
-                component_i = find_component - components.begin();
-            } else {
-                component_i = components.size();
-                components.push_back(Component<Components...>{.id = config.id, .base = T(depth, config.init), .is_stale = true});
+            auto &components = pool<T>();
+            auto id_hash = IdIndex::hash_of(config.id);
+            u32 component_i = find<T>(config.id, id_hash);
+            if (component_i == IdIndex::EMPTY) {
+                component_i = components.emplace(config.id, id_hash, depth, config.init).index;
+                component_ids[type_index<T>()].insert(id_hash, component_i);
             }
             auto &c = components[component_i];
-            component_indices.push_back(component_i);
-            auto &c_base = std::get<T>(c.base);
-            c_base.submit(*this, config.init);
+            auto generation = components.generation_of(component_i);
+            component_indices.push_back({type_index<T>(), component_i});
+            c.base.submit(*this, config.init);
             c.is_stale = false;
 
             if constexpr (std::same_as<T, Window>) {
                 ++depth;
-                return {.i = component_i, .depth = &depth};
+                return {.i = component_i, .generation = generation, .depth = &depth};
             } else {
-                return {.i = component_i};
+                return {.i = component_i, .generation = generation};
             }
         }
 
         template <typename T>
         T &get(std::string_view id) {
-            auto find_component = std::ranges::find_if(components, [&](const auto &c) { return c.id == id; });
-            return std::get<T>(find_component->base);
+            return pool<T>()[find<T>(id, IdIndex::hash_of(id))].base;
         }
 
         template <typename T>
-        T &get(ComponentHandle<T> c) {
-            return std::get<T>(components[c.i].base);
+        T &get(const ComponentHandle<T> &c) {
+            assert(pool<T>().contains({c.i, c.generation}));
+            return pool<T>()[c.i].base;
         }
 
         void render_frame() {
             auto &ui = *this;
-            for (size_t i : component_indices)
-                std::visit([&](auto &&c) { c.render(ui); }, components[i].base);
+            for (auto ref : component_indices)
+                visit(ref, [&](auto &c) { c.render(ui); });
             handle_events([&](const auto &event) {
                 switch (event.index()) {
                 case cuiui::EventType::MouseMotionEvent: {
@@ -135,17 +180,42 @@ namespace cuiui {
                 }
                 return false;
             });
-            std::ranges::for_each(component_indices | std::views::reverse, [&](size_t i) {
-                auto &c = components[i];
-                std::visit([&](auto &&c_base) { c_base.update(ui); }, c.base);
-            });
-            std::erase_if(components, [](const auto &c) { return c.is_stale; });
+            for (auto ref : component_indices | std::views::reverse)
+                visit(ref, [&](auto &c) { c.update(ui); });
+            (remove_stale<Components>(), ...);
+        }
+
+        // IdIndex::EMPTY if no component of type T has this id
+        template <typename T>
+        u32 find(std::string_view id, size_t id_hash) const {
+            const auto &components = pool<T>();
+            return component_ids[type_index<T>()].find(id, id_hash, [&](u32 i) { return components[i].id; });
+        }
+
+        // Calls fn with the component `ref` refers to, as its own type.
+        void visit(ComponentRef ref, auto &&fn) {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((ref.type == I ? (fn(std::get<I>(pools)[ref.i].base), true) : false) || ...);
+            }(std::index_sequence_for<Components...>{});
         }
 
         void handle_events(auto &&pred) {
             auto [first, last] = std::ranges::remove_if(events, pred);
             events.erase(first, last);
         }
+
+      private:
+        template <typename T>
+        void remove_stale() {
+            auto &components = pool<T>();
+            auto &ids = component_ids[type_index<T>()];
+            components.for_each([&](u32 i, auto &c) {
+                if (!c.is_stale)
+                    return;
+                ids.erase(c.id_hash, i);
+                components.erase(i);
+            });
+        }
     };
 
     using Context = BasicContext<
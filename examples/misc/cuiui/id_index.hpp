@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cuiui/math/types.hpp>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace cuiui {
+    // Open-addressing (linear probing) map from component id to slot index
+    // in BasicContext::components. Slots keep the full hash, so a probe only
+    // compares strings when the hashes match.
+    struct IdIndex {
+        static constexpr u32 EMPTY = ~u32{0};
+        static constexpr size_t MIN_CAPACITY = 64;
+
+        struct Slot {
+            size_t hash;
+            u32 index = EMPTY;
+        };
+
+        std::vector<Slot> slots;
+        size_t size = 0;
+
+        static size_t hash_of(std::string_view id) {
+            return std::hash<std::string_view>{}(id);
+        }
+
+        // `id_of(index)` returns the id stored at that component index.
+        u32 find(std::string_view id, size_t hash, auto &&id_of) const {
+            if (slots.empty())
+                return EMPTY;
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                const auto &slot = slots[i];
+                if (slot.index == EMPTY)
+                    return EMPTY;
+                if (slot.hash == hash && id_of(slot.index) == id)
+                    return slot.index;
+            }
+        }
+
+        // `id` must not be present yet.
+        void insert(size_t hash, u32 index) {
+            // stay at most half full, so probe runs stay short
+            if ((size + 1) * 2 > slots.size())
+                grow(std::max(MIN_CAPACITY, std::bit_ceil((size + 1) * 2)));
+            place(hash, index);
+            ++size;
+        }
+
+        // Backward-shift deletion: entries after the hole that probed past
+        // it move back, so no tombstones are needed.
+        void erase(size_t hash, u32 index) {
+            if (slots.empty())
+                return;
+            size_t mask = slots.size() - 1;
+            size_t hole = hash & mask;
+            while (slots[hole].index != index) {
+                if (slots[hole].index == EMPTY)
+                    return;
+                hole = (hole + 1) & mask;
+            }
+            for (size_t i = (hole + 1) & mask; slots[i].index != EMPTY; i = (i + 1) & mask) {
+                // distance from the home slot, which the move must not exceed
+                size_t home = slots[i].hash & mask;
+                if (((i - home) & mask) >= ((i - hole) & mask)) {
+                    slots[hole] = slots[i];
+                    hole = i;
+                }
+            }
+            slots[hole] = Slot{};
+            --size;
+        }
+
+      private:
+        void place(size_t hash, u32 index) {
+            size_t mask = slots.size() - 1;
+            size_t i = hash & mask;
+            while (slots[i].index != EMPTY)
+                i = (i + 1) & mask;
+            slots[i] = {hash, index};
+        }
+
+        void grow(size_t capacity) {
+            auto old_slots = std::move(slots);
+            slots.assign(capacity, Slot{});
+            for (const auto &slot : old_slots) {
+                if (slot.index != EMPTY)
+                    place(slot.hash, slot.index);
+            }
+        }
+    };
+} // namespace cuiui
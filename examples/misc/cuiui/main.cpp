@@ -5,6 +5,10 @@
 #include <iostream>
 #include <string>
 #include <cuiui/math/utility.hpp>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 
 constexpr const u8 font8x8_basic[128 * 8] = {
     // clang-format off
@@ -286,7 +290,7 @@ struct UiRenderer {
 
     void update(f32vec2 viewport_size) {
         modl_mat = scale(translate(f32mat4::identity(), {-1.0f, 1.0f, 0.0f}), {2.0f / static_cast<f32>(viewport_size[0]), -2.0f / static_cast<f32>(viewport_size[1]), 1.0f});
-        glViewport(0, 0, static_cast<u32>(viewport_size.x), static_cast<u32>(viewport_size.y));
+        gl_state().viewport(0, 0, static_cast<i32>(viewport_size.x), static_cast<i32>(viewport_size.y));
     }
 
     void render(auto &ui) {
@@ -391,6 +395,46 @@ struct UiRenderer {
 
 using namespace cuiui::components;
 
+// The profiler's totals for the last frame, one line per scope, and a
+// button that writes the retained events as a Chrome trace.
+struct ProfilerOverlay {
+    static constexpr size_t LINE_N = 24;
+    static constexpr const char *TRACE_PATH = "frame_trace.json";
+
+    // components keep a view of their id
+    std::array<std::string, LINE_N> ids;
+    std::array<std::string, LINE_N> lines;
+    std::string export_str = "Export trace";
+
+    ProfilerOverlay() {
+        for (size_t i = 0; i < LINE_N; ++i)
+            ids[i] = std::format("profiler_tx{}", i);
+    }
+
+    void submit(cuiui::Context &ui) {
+        ui.submit<Window>({.id = "profiler_window", .init{.pos{320, 20}, .dim{270, 460}}});
+        auto summary = profiler().summarize(gpu_timer().resolved_frame);
+        auto n = std::min(summary.size(), LINE_N);
+        for (size_t i = 0; i < n; ++i) {
+            const auto &s = summary[i];
+            lines[i].clear();
+            std::format_to(std::back_inserter(lines[i]), "{:>8} {:{}}{} {:.3f}ms", profiler().track_name(s.track_id), "", s.depth * 2, s.name, s.total_ms);
+            if (s.count > 1)
+                std::format_to(std::back_inserter(lines[i]), " x{}", s.count);
+            ui.submit<Text>({.id = ids[i], .init{.content = lines[i]}});
+        }
+        auto b = ui.submit<Button>({.id = "profiler_export"});
+        if (ui.get(b).pressed) {
+            export_str.clear();
+            if (profiler().write_chrome_trace(TRACE_PATH))
+                std::format_to(std::back_inserter(export_str), "Wrote {}", TRACE_PATH);
+            else
+                std::format_to(std::back_inserter(export_str), "ERROR: could not write {}", TRACE_PATH);
+        }
+        ui.submit<Text>({.id = "profiler_export_tx", .init{.content = export_str}});
+    }
+};
+
 int main() {
     cuiui::Context ui{};
     size_t b_counter = 0;
@@ -411,12 +455,16 @@ int main() {
 
     ui.submit<Window>({.id = "main_window", .init{.dim{600, 600}}});
     UiRenderer ui_renderer;
+    ProfilerOverlay profiler_overlay;
 
     f32vec3 clear_col{0, 0, 0};
 
+    FrameStats frame_stats("cuiui");
     while (true) {
+        frame_stats.tick();
         ui.new_frame();
         {
+            PROFILE_SCOPE("ui_submit");
             auto w = ui.submit<Window>({.id = "main_window"});
             if (ui.get(w).should_close)
                 break;
@@ -445,17 +493,28 @@ int main() {
                 fmt_counter_str();
             }
             ui.submit<Text>({.id = "tx1", .init{.content = counter_str}});
+            profiler_overlay.submit(ui);
+        }
+        {
+            PROFILE_SCOPE("ui_render_frame");
+            ui.render_frame();
         }
-        ui.render_frame();
 
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LEQUAL);
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glClearColor(clear_col[0], clear_col[1], clear_col[2], 1.0f);
-        glClearDepth(1.0f);
+        auto &state = gl_state();
+        state.enable(GL_DEPTH_TEST);
+        state.depth_func(GL_LEQUAL);
+        state.enable(GL_CULL_FACE);
+        state.enable(GL_BLEND);
+        state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.clear_color(clear_col[0], clear_col[1], clear_col[2], 1.0f);
+        state.clear_depth(1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        ui_renderer.render(ui);
+        {
+            GPU_PROFILE_SCOPE("ui_render");
+            ui_renderer.render(ui);
+        }
+        state.end_frame();
+        profiler().end_frame();
+        gpu_timer().end_frame();
     }
 }
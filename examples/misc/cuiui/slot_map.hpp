@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cuiui/math/types.hpp>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace cuiui {
+    // Slots live in fixed-size pages that are never reallocated, so values
+    // keep their address for as long as they exist and `emplace` constructs
+    // them in place. Erased slots go on a free list and are reused, with
+    // their generation bumped so handles to the old value stop matching.
+    template <typename T, u32 PAGE_SIZE = 256>
+    struct SlotMap {
+        static constexpr u32 NONE = ~u32{0};
+
+        struct Handle {
+            u32 index = NONE;
+            u32 generation = 0;
+        };
+
+        struct Slot {
+            std::optional<T> value;
+            u32 generation = 0;
+            u32 next_free = NONE;
+        };
+
+        std::vector<std::unique_ptr<Slot[]>> pages;
+        u32 slot_n = 0;
+        u32 free_head = NONE;
+        size_t size = 0;
+
+        Handle emplace(auto &&...args) {
+            u32 index = free_head;
+            if (index != NONE) {
+                free_head = slot(index).next_free;
+            } else {
+                if (slot_n == pages.size() * PAGE_SIZE)
+                    pages.push_back(std::make_unique<Slot[]>(PAGE_SIZE));
+                index = slot_n++;
+            }
+            auto &s = slot(index);
+            s.value.emplace(std::forward<decltype(args)>(args)...);
+            s.next_free = NONE;
+            ++size;
+            return {index, s.generation};
+        }
+
+        void erase(u32 index) {
+            auto &s = slot(index);
+            if (!s.value)
+                return;
+            s.value.reset();
+            ++s.generation;
+            s.next_free = free_head;
+            free_head = index;
+            --size;
+        }
+
+        bool contains(Handle handle) const {
+            if (handle.index >= slot_n)
+                return false;
+            const auto &s = slot(handle.index);
+            return s.value && s.generation == handle.generation;
+        }
+
+        // nullptr once the value has been erased
+        T *get(Handle handle) {
+            return contains(handle) ? &*slot(handle.index).value : nullptr;
+        }
+
+        // `index` must hold a value.
+        T &operator[](u32 index) {
+            return *slot(index).value;
+        }
+        const T &operator[](u32 index) const {
+            return *slot(index).value;
+        }
+
+        u32 generation_of(u32 index) const {
+            return slot(index).generation;
+        }
+
+        // fn(index, value) for each value in slot order. `fn` may erase
+        // the value it is given.
+        void for_each(auto &&fn) {
+            for (u32 i = 0; i < slot_n; ++i) {
+                auto &s = slot(i);
+                if (s.value)
+                    fn(i, *s.value);
+            }
+        }
+
+      private:
+        Slot &slot(u32 index) {
+            return pages[index / PAGE_SIZE][index % PAGE_SIZE];
+        }
+        const Slot &slot(u32 index) const {
+            return pages[index / PAGE_SIZE][index % PAGE_SIZE];
+        }
+    };
+} // namespace cuiui
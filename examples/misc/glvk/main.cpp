@@ -1,6 +1,7 @@
 
 #include "opengl.hpp"
 #include "vulkan.hpp"
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 
 void handle_events(AppState &state, WindowHandle w) {
     while (!w->events.empty()) {
@@ -40,7 +41,9 @@ int main() {
         vkapp.init(state, w);
     }
 
+    FrameStats frame_stats("glvk");
     while (true) {
+        frame_stats.tick();
         {
             auto w = ui.window({.id = "w_gl"});
             if (w->should_close)
@@ -1,4 +1,5 @@
 #include <cuiui/platform/win32.hpp>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 
 struct Window : cuiui::WindowState {
     using WindowHandleType = cuiui::WindowHandle<Window>;
@@ -56,7 +57,9 @@ int main() {
     UiContext ui;
     ui.window({.id = "w", .title = "Raw Win32 Window", .size{400, 400}});
 
+    FrameStats frame_stats("raw_win32");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;
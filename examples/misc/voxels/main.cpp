@@ -12,6 +12,7 @@ namespace cuiui_default = cuiui::platform::defaults;
 
 #include "math.hpp"
 #include <numbers>
+#include <1_getting_started/2_drawing/0_common/frame_stats.hpp>
 
 const uint32_t TILE_NX = 16, TILE_NY = 16;
 i32vec2 CHUNK_POS = {-8, -8};
@@ -370,7 +371,9 @@ int main() {
     reset_view();
     reset_tiles();
 
+    FrameStats frame_stats("voxels");
     while (true) {
+        frame_stats.tick();
         auto w = ui.window({.id = "w"});
         if (w->should_close)
             break;